@@ -1,12 +1,75 @@
-#include <malloc.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "phone_forward.h"
 
+/** @brief Liczba znaków, z których mogą się składać numery.
+ * Przy zdefiniowanym PHONE_NUMBER_DIGITS_ONLY numery składają się wyłącznie z cyfr '0'-'9', a węzły drzewa mają
+ * dziesięć zamiast dwunastu wskaźników na dzieci.
+ */
+#ifdef PHONE_NUMBER_DIGITS_ONLY
+#define PHONE_NUMBER_DIGITS 10
+#else
 #define PHONE_NUMBER_DIGITS 12
+#endif
+
+/** @brief Wpis puli numerów, na które są wykonywane przekierowania.
+ */
+typedef struct PhoneTarget {
+    //! Następny wpis w tym samym kubełku tablicy haszującej.
+    struct PhoneTarget *next;
+    //! Liczba węzłów, których przekierowaniem jest ten numer.
+    size_t refcount;
+    //! Skrót numeru.
+    uint64_t hash;
+    //! Numer, na który są wykonywane przekierowania.
+    char number[];
+} PhoneTarget;
+
+/** @brief Pula numerów, na które są wykonywane przekierowania.
+ * Każdy numer jest przechowywany jednokrotnie, niezależnie od liczby przekierowań, które na niego wskazują, więc
+ * przekierowania i ich inwersje współdzielą ten sam napis.
+ */
+typedef struct TargetPool {
+    //! Alokator pamięci drzewa.
+    const PhoneForwardAllocator *allocator;
+    //! Liczba numerów w puli.
+    size_t target_amount;
+    //! Liczba kubełków tablicy haszującej, potęga dwójki.
+    size_t bucket_amount;
+    //! Kubełki tablicy haszującej.
+    PhoneTarget **buckets;
+    //! Liczba kubełków dolnej połowy tablicy, do których dołączono już łańcuchy odpowiadających im kubełków górnej
+    //! połowy podczas zmniejszania tablicy przez @ref targetPoolShrink; 0, jeżeli tablica nie jest zmniejszana.
+    size_t merged;
+} TargetPool;
+
+/** @brief Znaki odpowiadające kolejnym indeksom tablicy @p next w drzewie trie.
+ */
+static const char PHONE_NUMBER_DIGIT_CHARS[PHONE_NUMBER_DIGITS] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+#ifndef PHONE_NUMBER_DIGITS_ONLY
+                                                                   '*', '#'
+#endif
+};
+
+/** @brief Indeksy tablicy @p next odpowiadające znakom, powiększone o 1, lub 0 dla znaków niebędących cyframi.
+ * Tablica zastępuje porównania w @ref numDigitToIndex i @ref numDigitIsCorrect jednym odczytem.
+ */
+static const unsigned char PHONE_NUMBER_DIGIT_INDEX[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+#ifndef PHONE_NUMBER_DIGITS_ONLY
+    ['*'] = 11, ['#'] = 12,
+#endif
+};
+
+/** @brief Spójny blok pamięci, do którego @ref phfwdRelocate przenosi najczęściej odwiedzane węzły.
+ */
+typedef struct PhoneForwardPacked PhoneForwardPacked;
 
 /** @brief Struktura przechowująca przekierowania numerów telefonów działająca na zasadzie drzewa trie.
+ * Węzeł przechowuje tylko dane potrzebne przy przechodzeniu drzewa. Dane całej struktury są w @ref PhoneForwardRoot.
  */
 struct PhoneForward {
     //! Wskazuje na tablicę zawierającą PHONE_NUMBER_DIGITS wskaźników reprezentujących kolejną cyfrę prefiksu w drzewie
@@ -16,12 +79,59 @@ struct PhoneForward {
     //! aktualną pozycję w drzewie trie. Jeżeli NULL, to prawidłowy prefiks to najbliższe nie-NULLowe redirection na
     //! drodze do korzenia.
     char *redirection;
+    //! Inwersja przekierowania zapisanego w tym węźle lub NULL, jeżeli węzeł nie ma przekierowania.
+    Inversion *inversion;
+    //! Skrót poddrzewa zakorzenionego w tym węźle. Równy 0 wtedy i tylko wtedy, gdy poddrzewo nie zawiera żadnych
+    //! przekierowań.
+    uint64_t hash;
+    //! Liczba odwiedzin węzła przez wyszukiwania przekierowań od ostatniego przenoszenia, zmniejszana o połowę przy
+    //! każdym przenoszeniu. Licznik jest 64-bitowy, bo po przepełnieniu gorący węzeł wyglądałby na nieodwiedzany, a
+    //! @ref phfwdRelocate zakłada, że dziecko nie ma więcej odwiedzin niż rodzic.
+    uint64_t hits;
+};
+
+/** @brief Korzeń drzewa razem z danymi dotyczącymi całej struktury.
+ * Wskaźnik na strukturę PhoneForward zwracany przez @ref phfwdNew wskazuje na pole @p node, które jest pierwszym
+ * polem, więc funkcje otrzymujące korzeń odczytują pozostałe dane przez @ref phfwdRoot.
+ */
+typedef struct PhoneForwardRoot {
+    //! Węzeł korzenia drzewa.
+    PhoneForward node;
     //! Ilość inwersji w drzewie.
     size_t inversion_amount;
     //! Aktualna pojemność inwersji w drzewie.
     size_t inversion_capacity;
     //! Przechowuje inwersje wszystkich przekierowań dodanych do tego drzewa.
     Inversion **inversions;
+    //! Czy inwersje są posortowane po źródłach przekierowań.
+    bool inversions_sorted;
+    //! Czy @ref phfwdGet zlicza odwiedziny węzłów.
+    bool profiling;
+    //! Pula numerów, na które są wykonywane przekierowania.
+    TargetPool *targets;
+    //! Alokator, przez który przydzielana jest cała pamięć drzewa.
+    PhoneForwardAllocator *allocator;
+    //! Blok z przeniesionymi węzłami lub NULL.
+    PhoneForwardPacked *packed;
+} PhoneForwardRoot;
+
+/** @brief Przeniesiony węzeł razem z tablicą wskaźników na dzieci.
+ */
+typedef struct PhoneForwardPackedNode {
+    //! Węzeł.
+    PhoneForward node;
+    //! Tablica wskaźników na dzieci węzła.
+    PhoneForward *next[PHONE_NUMBER_DIGITS];
+} PhoneForwardPackedNode;
+
+/** @brief Spójny blok pamięci z przeniesionymi węzłami ułożonymi w kolejności przechodzenia w głąb.
+ * Węzły bloku nie są zwalniane pojedynczo; usunięte węzły zajmują miejsce do kolejnego przenoszenia.
+ */
+struct PhoneForwardPacked {
+    //! Liczba węzłów w bloku.
+    size_t amount;
+    //! Węzły.
+    PhoneForwardPackedNode nodes[];
 };
 
 /** @brief Struktura przechowująca ciąg numerów telefonów.
@@ -38,13 +148,569 @@ struct PhoneNumbers {
 /** @brief Struktura przechowująca inwersję przekierowania numeru telefonu.
  */
 struct Inversion {
+    //! Numer, na który jest wykonywane przekierowanie. Napis należy do puli numerów korzenia i jest współdzielony z
+    //! polem redirection węzła.
     char *forward;
+    //! Numer przekierowywany.
     char *origin;
 };
 
+/** @brief Ramka stosu iteratora różnic, odpowiadająca parze węzłów na tej samej głębokości obu drzew.
+ */
+typedef struct PhoneForwardDiffFrame {
+    //! Węzeł starego drzewa lub NULL, jeżeli w starym drzewie nie ma takiego węzła.
+    PhoneForward const *old_node;
+    //! Węzeł nowego drzewa lub NULL, jeżeli w nowym drzewie nie ma takiego węzła.
+    PhoneForward const *new_node;
+    //! Indeks kolejnego dziecka do odwiedzenia lub -1, jeżeli przekierowania węzłów nie zostały jeszcze porównane.
+    int child;
+} PhoneForwardDiffFrame;
+
+/** @brief Struktura iteratora różnic pomiędzy dwiema strukturami PhoneForward.
+ */
+struct PhoneForwardDiff {
+    //! Liczba ramek na stosie.
+    size_t depth;
+    //! Pojemność stosu ramek i bufora prefiksu.
+    size_t capacity;
+    //! Stos ramek przechodzenia obu drzew.
+    PhoneForwardDiffFrame *stack;
+    //! Numer odpowiadający aktualnie odwiedzanej parze węzłów.
+    char *prefix;
+    //! Czy nie udało się alokować pamięci; wtedy iterator nie wyznacza kolejnych różnic.
+    bool failed;
+};
+
+/** @brief Wartość oznaczająca brak przesunięcia w puli napisów zamrożonej struktury.
+ */
+#define FROZEN_NONE UINT32_MAX
+
+/** @brief Węzeł zamrożonej struktury przekierowań.
+ * Dzieci węzła zajmują spójny fragment tablicy węzłów, zaczynający się od indeksu @p first_child, w kolejności
+ * rosnących indeksów cyfr. Pozycję dziecka wyznacza liczba ustawionych bitów mapy @p children poniżej bitu cyfry.
+ */
+typedef struct PhoneForwardFrozenNode {
+    //! Indeks pierwszego dziecka w tablicy węzłów.
+    uint32_t first_child;
+    //! Przesunięcie przekierowania w puli napisów lub FROZEN_NONE, jeżeli węzeł nie ma przekierowania.
+    uint32_t redirection;
+    //! Mapa bitowa dzieci węzła, bit i odpowiada cyfrze o indeksie i.
+    uint16_t children;
+} PhoneForwardFrozenNode;
+
+/** @brief Inwersja przekierowania w zamrożonej strukturze.
+ */
+typedef struct PhoneForwardFrozenInversion {
+    //! Przesunięcie numeru, na który jest wykonywane przekierowanie, w puli napisów.
+    uint32_t forward;
+    //! Przesunięcie numeru przekierowywanego w puli napisów.
+    uint32_t origin;
+} PhoneForwardFrozenInversion;
+
+/** @brief Zamrożona, przeznaczona tylko do odczytu postać struktury PhoneForward.
+ */
+struct PhoneForwardFrozen {
+    //! Liczba węzłów.
+    size_t node_amount;
+    //! Węzły drzewa trie w kolejności przechodzenia wszerz, korzeń ma indeks 0.
+    PhoneForwardFrozenNode *nodes;
+    //! Liczba inwersji.
+    size_t inversion_amount;
+    //! Inwersje posortowane po numerach, na które są wykonywane przekierowania.
+    PhoneForwardFrozenInversion *inversions;
+    //! Rozmiar puli napisów.
+    size_t pool_size;
+    //! Pula napisów, w której każdy numer występuje co najwyżej raz.
+    char *pool;
+};
+
+/** @brief Pomocnicza struktura do budowania puli napisów zamrożonej struktury.
+ */
+typedef struct FrozenPoolBuilder {
+    //! Zajętość puli.
+    size_t size;
+    //! Pojemność puli.
+    size_t capacity;
+    //! Budowana pula napisów.
+    char *pool;
+    //! Rozmiar tablicy haszującej, potęga dwójki.
+    size_t slot_amount;
+    //! Liczba zajętych pozycji tablicy haszującej.
+    size_t slot_used;
+    //! Tablica haszująca przesunięć napisów w puli, FROZEN_NONE oznacza wolną pozycję.
+    uint32_t *slots;
+} FrozenPoolBuilder;
+
+/** @brief Wyszukuje numer w puli napisów i dodaje go, jeżeli go w niej nie ma.
+ * @param builder - wskaźnik na budowaną pulę.
+ * @param num - wskaźnik na numer.
+ * @return Przesunięcie numeru w puli lub FROZEN_NONE, gdy nie udało się alokować pamięci.
+ */
+static uint32_t frozenPoolIntern(FrozenPoolBuilder *builder, const char *num);
+
+/** @brief Komparator inwersji zamrożonej struktury, porządkujący po numerach, na które są wykonywane przekierowania.
+ * @param inv1 - wskaźnik na pierwszą inwersję.
+ * @param inv2 - wskaźnik na drugą inwersję.
+ * @param pool - wskaźnik na pulę napisów.
+ * @return Zmienna typu int o wartości zgodnej z działaniem komparatorów.
+ */
+static int frozenInvrsCmp(const PhoneForwardFrozenInversion *inv1, const PhoneForwardFrozenInversion *inv2,
+                          const char *pool);
+
+/** @brief Porównuje numer z puli z prefiksem numeru @p num o długości @p len.
+ * @param pool_num - wskaźnik na numer z puli.
+ * @param num - wskaźnik na numer.
+ * @param len - długość prefiksu.
+ * @return Zmienna typu int o wartości zgodnej z działaniem komparatorów.
+ */
+static int frozenPrefixCmp(const char *pool_num, const char *num, size_t len);
+
+/** @brief Tworzy pustą strukturę ciągu numerów telefonów.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneNumbers *phnumNew(void);
+
+/** @brief Przydziela pamięć alokatorem drzewa.
+ * @param allocator - wskaźnik na alokator.
+ * @param size - rozmiar pamięci.
+ * @return Wskaźnik na przydzieloną pamięć lub NULL, gdy nie udało się alokować pamięci.
+ */
+static inline void *memAlloc(const PhoneForwardAllocator *allocator, size_t size);
+
+/** @brief Zmienia rozmiar pamięci przydzielonej alokatorem drzewa.
+ * @param allocator - wskaźnik na alokator.
+ * @param ptr - wskaźnik na pamięć.
+ * @param old_size - dotychczasowy rozmiar pamięci.
+ * @param new_size - nowy rozmiar pamięci.
+ * @return Wskaźnik na pamięć o nowym rozmiarze lub NULL, gdy nie udało się alokować pamięci.
+ */
+static inline void *memRealloc(const PhoneForwardAllocator *allocator, void *ptr, size_t old_size, size_t new_size);
+
+/** @brief Zwalnia pamięć przydzieloną alokatorem drzewa.
+ * @param allocator - wskaźnik na alokator.
+ * @param ptr - wskaźnik na pamięć.
+ * @param size - rozmiar pamięci.
+ */
+static inline void memFree(const PhoneForwardAllocator *allocator, void *ptr, size_t size);
+
+/** @brief Tworzy pustą pulę numerów.
+ * @param allocator - wskaźnik na alokator drzewa.
+ * @return Wskaźnik na utworzoną pulę lub NULL, gdy nie udało się alokować pamięci.
+ */
+static TargetPool *targetPoolNew(const PhoneForwardAllocator *allocator);
+
+/** @brief Usuwa pulę numerów wraz ze wszystkimi pozostałymi w niej wpisami.
+ * @param pool - wskaźnik na usuwaną pulę.
+ */
+static void targetPoolDelete(TargetPool *pool);
+
+/** @brief Zwraca numer z puli równy @p num, dodając go do puli, jeżeli go w niej nie ma.
+ * Zwiększa licznik odwołań numeru, który musi być zwolniony za pomocą funkcji @ref targetRelease.
+ * @param pool - wskaźnik na pulę.
+ * @param num - wskaźnik na numer.
+ * @return Wskaźnik na numer w puli lub NULL, gdy nie udało się alokować pamięci.
+ */
+static char *targetIntern(TargetPool *pool, const char *num);
+
+/** @brief Zmniejsza licznik odwołań numeru z puli i usuwa go, jeżeli licznik spadł do zera.
+ * @param pool - wskaźnik na pulę.
+ * @param target - wskaźnik na numer zwrócony przez @ref targetIntern.
+ */
+static void targetRelease(TargetPool *pool, char *target);
+
+/** @brief Zwraca wpis puli przechowujący numer @p target.
+ * @param target - wskaźnik na numer zwrócony przez @ref targetIntern.
+ * @return Wskaźnik na wpis puli.
+ */
+static inline PhoneTarget *targetEntry(char *target);
+
+/** @brief Wyznacza kubełek, w którym leżą numery o skrócie @p hash.
+ * @param pool - wskaźnik na pulę.
+ * @param hash - skrót numeru.
+ * @return Indeks kubełka.
+ */
+static inline size_t targetBucket(const TargetPool *pool, uint64_t hash);
+
+/** @brief Zmniejsza o połowę tablicę haszującą puli zapełnioną w mniej niż jednej czwartej.
+ * Tablica jest zmniejszana w miejscu: łańcuch kubełka i + n/2 jest dołączany do łańcucha kubełka i, gdzie n to
+ * liczba kubełków, więc zmniejszanie można przerwać po dowolnym kubełku, a pula działa poprawnie także pomiędzy
+ * wywołaniami.
+ * @param pool - wskaźnik na pulę.
+ * @param budget - wskaźnik na liczbę kubełków, które można jeszcze scalić; jest zmniejszana o liczbę scalonych.
+ * @param reclaimed - wskaźnik na licznik odzyskanych bajtów.
+ * @return Wartość @p true, jeżeli tablicy nie trzeba już zmniejszać, lub @p false, jeżeli wyczerpano limit.
+ */
+static bool targetPoolShrink(TargetPool *pool, size_t *budget, size_t *reclaimed);
+
+/** @brief Tworzy inwersję przekierowania na numer z puli.
+ * Inwersja nie przejmuje własności napisu @p forward, który należy do puli numerów drzewa.
+ * @param forward - wskaźnik na numer z puli, na który jest wykonywane przekierowanie.
+ * @param num_origin - wskaźnik na numer przekierowywany.
+ * @param allocator - wskaźnik na alokator drzewa.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się alokować pamięci.
+ */
+static Inversion *invrsNewPooled(char *forward, const char *num_origin, const PhoneForwardAllocator *allocator);
+
+/** @brief Usuwa inwersję utworzoną przez @ref invrsNewPooled.
+ * Nie zwalnia numeru, na który jest wykonywane przekierowanie, ponieważ należy on do puli numerów drzewa. Nic nie
+ * robi, jeśli wskaźnik @p inv ma wartość NULL.
+ * @param inv - wskaźnik na usuwaną strukturę.
+ * @param allocator - wskaźnik na alokator drzewa.
+ */
+static void invrsDeletePooled(Inversion *inv, const PhoneForwardAllocator *allocator);
+
+/** @brief Zwraca dane struktury, której korzeniem jest @p pf.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @return Wskaźnik na dane struktury.
+ */
+static inline PhoneForwardRoot *phfwdRoot(PhoneForward *pf);
+
+/** @brief Zwraca dane struktury, której korzeniem jest @p pf, do odczytu.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @return Wskaźnik na dane struktury.
+ */
+static inline const PhoneForwardRoot *phfwdRootConst(PhoneForward const *pf);
+
+/** @brief Inicjalizuje węzeł bez dzieci i przekierowania.
+ * @param pf - wskaźnik na inicjalizowany węzeł.
+ * @param allocator - wskaźnik na alokator drzewa.
+ * @return Wartość @p true lub @p false, gdy nie udało się alokować pamięci.
+ */
+static bool phfwdNodeInit(PhoneForward *pf, const PhoneForwardAllocator *allocator);
+
+/** @brief Tworzy nowy węzeł drzewa bez przekierowań.
+ * @param allocator - wskaźnik na alokator drzewa.
+ * @return Wskaźnik na utworzony węzeł lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneForward *phfwdNodeNew(const PhoneForwardAllocator *allocator);
+
+/** @brief Usuwa poddrzewo zakorzenione w @p pf, zwalniając jego przekierowania w puli @p targets.
+ * Pamięć jest zwracana do alokatora puli @p targets, z wyjątkiem węzłów leżących w bloku @p packed.
+ * @param pf - wskaźnik na korzeń usuwanego poddrzewa.
+ * @param targets - wskaźnik na pulę numerów drzewa.
+ * @param packed - wskaźnik na blok przeniesionych węzłów drzewa lub NULL.
+ * @return Liczba bajtów zwróconych do alokatora przez zwolnione węzły.
+ */
+static size_t phfwdDeleteNode(PhoneForward *pf, TargetPool *targets, const PhoneForwardPacked *packed);
+
+/** @brief Sprawdza, czy węzeł leży w bloku przeniesionych węzłów.
+ * @param packed - wskaźnik na blok przeniesionych węzłów lub NULL.
+ * @param pf - wskaźnik na węzeł.
+ * @return Wartość @p true, jeżeli węzeł leży w bloku, lub @p false w przeciwnym wypadku.
+ */
+static bool phfwdIsPacked(const PhoneForwardPacked *packed, const PhoneForward *pf);
+
+/** @brief Liczba zapytań wykonywanych jednocześnie przez @ref phfwdGetBatch.
+ */
+#define PHFWD_BATCH_WIDTH 16
+
+/** @brief Stan pojedynczego zapytania w przeplatanym przechodzeniu drzewa.
+ */
+typedef struct PhoneForwardLookup {
+    //! Aktualny węzeł, ważny, gdy @p slot ma wartość NULL.
+    PhoneForward const *node;
+    //! Pobierany z wyprzedzeniem wskaźnik na dziecko aktualnego węzła lub NULL.
+    PhoneForward *const *slot;
+    //! Indeks zapytania.
+    size_t query;
+    //! Głębokość aktualnego węzła.
+    size_t depth;
+    //! Głębokość najgłębszego węzła z przekierowaniem na ścieżce.
+    size_t deepest_found;
+    //! Przekierowanie najgłębszego węzła z przekierowaniem na ścieżce lub NULL.
+    const char *redirection;
+} PhoneForwardLookup;
+
+/** @brief Tworzy wynik funkcji @ref phfwdGet.
+ * @param redirection - wskaźnik na przekierowanie najgłębszego pasującego prefiksu lub NULL, jeżeli numer nie jest
+ * przekierowywany.
+ * @param num - wskaźnik na numer.
+ * @param deepest_found - długość najgłębszego pasującego prefiksu.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneNumbers *phnumNewForward(const char *redirection, const char *num, size_t deepest_found);
+
+/** @brief Stan przenoszenia węzłów przez @ref phfwdRelocate.
+ * Węzeł jest wybierany, jeżeli ma więcej odwiedzin niż @p threshold, albo dokładnie tyle, dopóki nie wyczerpie się
+ * @p ties. Oba przejścia drzewa odwiedzają węzły w tej samej kolejności, więc wybierają te same węzły.
+ */
+typedef struct PhoneForwardRelocation {
+    //! Blok, z którego przenoszone są węzły, lub NULL.
+    const PhoneForwardPacked *old_packed;
+    //! Czy przejście zmienia drzewo, czy tylko zlicza węzły.
+    bool apply;
+    //! Tworzony blok lub NULL, jeżeli żaden węzeł nie został wybrany.
+    PhoneForwardPacked *packed;
+    //! Najmniejsza liczba odwiedzin wybieranego węzła.
+    uint64_t threshold;
+    //! Liczba węzłów o liczbie odwiedzin równej @p threshold, które można jeszcze wybrać.
+    size_t ties;
+    //! Liczba wybranych węzłów.
+    size_t selected;
+    //! Węzły i tablice dzieci przydzielone dla węzłów opuszczających stary blok.
+    PhoneForward **spare;
+    //! Liczba węzłów opuszczających stary blok.
+    size_t evicted;
+} PhoneForwardRelocation;
+
+/** @brief Rekurencyjnie zbiera liczby odwiedzin niepustych węzłów poddrzewa.
+ * @param pf - wskaźnik na korzeń poddrzewa.
+ * @param hits - wskaźnik na tablicę liczb odwiedzin lub NULL, jeżeli mają być tylko zliczone.
+ * @param amount - wskaźnik na liczbę zebranych wartości.
+ */
+static void phfwdCollectHits(const PhoneForward *pf, uint64_t *hits, size_t *amount);
+
+/** @brief Rekurencyjnie przenosi poddrzewo wskazywane przez @p slot.
+ * Wybrane węzły trafiają do nowego bloku w kolejności przechodzenia w głąb, węzły starego bloku, które nie zostały
+ * wybrane, otrzymują osobną pamięć, a liczby odwiedzin są zmniejszane o połowę. Przy przejściu zliczającym
+ * drzewo nie jest zmieniane.
+ * @param state - wskaźnik na stan przenoszenia.
+ * @param slot - wskaźnik na pole tablicy dzieci rodzica, wskazujące na korzeń poddrzewa.
+ * @param allocator - wskaźnik na alokator drzewa.
+ */
+static void phfwdRelocateNode(PhoneForwardRelocation *state, PhoneForward **slot,
+                              const PhoneForwardAllocator *allocator);
+
+/** @brief Węzeł drzewa usunięć nakładki.
+ */
+typedef struct OverlayTombstone {
+    //! Dzieci węzła, indeksowane tak jak w drzewie przekierowań.
+    struct OverlayTombstone *next[PHONE_NUMBER_DIGITS];
+    //! Czy usunięto przekierowania bazy wszystkich numerów o prefiksie odpowiadającym węzłowi.
+    bool removed;
+} OverlayTombstone;
+
+/** @brief Struktura nakładki na współdzieloną strukturę przekierowań.
+ * Przekierowanie numeru @p x w nakładce to przekierowanie z drzewa zmian, jeżeli jest w nim zapisane; w przeciwnym
+ * wypadku przekierowanie z bazy, o ile żaden prefiks @p x nie został usunięty. Usunięcie prefiksu usuwa też
+ * wszystkie wcześniejsze zmiany w jego poddrzewie, więc przekierowania z drzewa zmian są zawsze nowsze od usunięć.
+ */
+struct PhoneForwardOverlay {
+    //! Baza, tylko do odczytu.
+    PhoneForward const *base;
+    //! Przekierowania dodane w nakładce.
+    PhoneForward *delta;
+    //! Korzeń drzewa usunięć lub NULL, jeżeli nic nie usunięto.
+    OverlayTombstone *tombstones;
+};
+
+/** @brief Rekurencyjnie usuwa poddrzewo usunięć.
+ * @param node - wskaźnik na korzeń poddrzewa.
+ */
+static void overlayTombstoneDelete(OverlayTombstone *node);
+
+/** @brief Sprawdza, czy przekierowanie bazy z numeru @p origin jest przesłonięte przez nakładkę.
+ * @param ov - wskaźnik na nakładkę.
+ * @param origin - wskaźnik na prawidłowy numer.
+ * @return Wartość @p true, jeżeli nakładka zmienia lub usuwa przekierowanie numeru @p origin.
+ */
+static bool overlayShadows(PhoneForwardOverlay const *ov, const char *origin);
+
+/** @brief Wyznacza przekierowanie numeru w nakładce bez alokowania pamięci.
+ * @param ov - wskaźnik na nakładkę.
+ * @param num - wskaźnik na prawidłowy numer.
+ * @param deepest_found - wskaźnik, pod który jest zapisywana długość najdłuższego pasującego prefiksu.
+ * @return Wskaźnik na przekierowanie najdłuższego pasującego prefiksu lub NULL, jeżeli numer nie jest przekierowany.
+ */
+static const char *overlayResolve(PhoneForwardOverlay const *ov, const char *num, size_t *deepest_found);
+
+/** @brief Stan przyrostowego porządkowania struktury przez @ref phfwdCompact.
+ * Pozycja jest zapamiętywana jako numer węzła, od którego należy wznowić przechodzenie, więc pozostaje poprawna
+ * po zmianach struktury pomiędzy wywołaniami.
+ */
+struct PhoneForwardCompactor {
+    //! Numer węzła, od którego należy wznowić przechodzenie.
+    char *cursor;
+    //! Długość numeru @p cursor; 0 oznacza początek nowego przejścia.
+    size_t cursor_len;
+    //! Numer aktualnie odwiedzanego węzła.
+    char *path;
+    //! Pojemność buforów @p cursor i @p path.
+    size_t capacity;
+    //! Liczba kroków, które można jeszcze wykonać w aktualnym wywołaniu: odwiedzin węzłów lub scaleń kubełków.
+    size_t budget;
+    //! Liczba bajtów odzyskanych w aktualnym wywołaniu.
+    size_t reclaimed;
+    //! Czy przechodzenie zostało zakończone i zmniejszane są tablice korzenia.
+    bool shrinking;
+};
+
+/** @brief Rekurencyjnie porządkuje poddrzewo, usuwając w kolejności wstecznej węzły bez przekierowań w poddrzewach.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param node - wskaźnik na odwiedzany węzeł.
+ * @param depth - głębokość odwiedzanego węzła.
+ * @param resume - czy przechodzenie jest wznawiane wewnątrz poddrzewa tego węzła.
+ * @param pc - wskaźnik na stan porządkowania.
+ * @return Wartość @p true, jeżeli przejście poddrzewa zostało dokończone, lub @p false, jeżeli przerwano je po
+ *         wyczerpaniu limitu odwiedzanych węzłów lub gdy nie udało się alokować pamięci.
+ */
+static bool phfwdCompactNode(PhoneForward *pf, PhoneForward *node, size_t depth, bool resume,
+                             PhoneForwardCompactor *pc);
+
+/** @brief Zmniejsza tablice korzenia, które są znacznie większe niż przechowywane w nich dane.
+ * Scalenie jednego kubełka puli numerów i zmniejszenie tablicy inwersji są liczone jako jeden krok, tak jak
+ * odwiedzenie węzła, a odzyskane bajty są doliczane do stanu porządkowania.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param pc - wskaźnik na stan porządkowania.
+ * @return Wartość @p true, jeżeli zmniejszanie zostało dokończone, lub @p false, jeżeli wyczerpano limit.
+ */
+static bool phfwdShrinkArrays(PhoneForward *pf, PhoneForwardCompactor *pc);
+
+/** @brief Liczba inwersji przeglądanych przez jedno zadanie równoległego wyznaczania przeciwobrazu.
+ */
+#define PARALLEL_REVERSE_CHUNK 4096
+
+/** @brief Liczba zadań przypadających na wątek w jednej rundzie scalania.
+ */
+#define PARALLEL_TASKS_PER_THREAD 4
+
+/** @brief Pula wątków wykonujących zadania równoległego wyznaczania przeciwobrazu.
+ * Zadania jednego zlecenia są ponumerowane, a wolne wątki pobierają kolejne numery ze wspólnego licznika, więc
+ * wątek, który skończył swoje zadania wcześniej, przejmuje pracę pozostałych.
+ */
+struct PhoneForwardThreadPool {
+    //! Liczba wątków roboczych, nie licząc wątku zlecającego.
+    size_t thread_amount;
+    //! Wątki robocze.
+    pthread_t *threads;
+    //! Chroni wszystkie pozostałe pola.
+    pthread_mutex_t mutex;
+    //! Sygnalizuje nowe zlecenie lub zakończenie pracy puli.
+    pthread_cond_t work_cond;
+    //! Sygnalizuje wykonanie wszystkich zadań zlecenia.
+    pthread_cond_t done_cond;
+    //! Szereguje zlecenia z różnych wątków.
+    pthread_mutex_t run_mutex;
+    //! Czy pula kończy pracę.
+    bool stop;
+    //! Numer aktualnego zlecenia.
+    size_t generation;
+    //! Funkcja wykonująca zadanie o podanym numerze.
+    void (*job)(void *arg, size_t task);
+    //! Argument funkcji wykonującej zadanie.
+    void *job_arg;
+    //! Liczba zadań zlecenia.
+    size_t task_amount;
+    //! Numer kolejnego zadania do pobrania.
+    size_t next_task;
+    //! Liczba wykonanych zadań.
+    size_t finished_tasks;
+};
+
+/** @brief Posortowany ciąg numerów wyznaczony przez jedno zadanie lub powstały przez scalenie.
+ */
+typedef struct ParallelRun {
+    //! Numery.
+    char **numbers;
+    //! Liczba numerów.
+    size_t amount;
+} ParallelRun;
+
+/** @brief Fragment scalania dwóch ciągów, wyznaczony metodą ścieżki scalania.
+ */
+typedef struct ParallelMergeTask {
+    //! Pierwszy scalany ciąg.
+    const ParallelRun *a;
+    //! Drugi scalany ciąg.
+    const ParallelRun *b;
+    //! Ciąg wynikowy.
+    char **out;
+    //! Początek fragmentu wyniku.
+    size_t begin;
+    //! Koniec fragmentu wyniku.
+    size_t end;
+} ParallelMergeTask;
+
+/** @brief Stan równoległego wyznaczania przeciwobrazu.
+ */
+typedef struct ParallelReverse {
+    //! Przeszukiwana struktura.
+    PhoneForward const *pf;
+    //! Numer, dla którego wyznaczany jest przeciwobraz.
+    const char *num;
+    //! Czy wynik ma zawierać tylko numery @p x, dla których phfwdGet(x) = num.
+    bool get_reverse;
+    //! Ciągi wyznaczone przez kolejne zadania.
+    ParallelRun *runs;
+    //! Zadania aktualnej rundy scalania.
+    ParallelMergeTask *merges;
+    //! Liczba zadań aktualnej rundy scalania.
+    size_t merge_amount;
+    //! Liczba unikalnych numerów w kolejnych fragmentach wyniku przy usuwaniu powtórzeń.
+    size_t *unique;
+    //! Ciąg, z którego usuwane są powtórzenia.
+    char **dedup;
+    //! Kopia ciągu sprzed usuwania powtórzeń, z którą porównywane są numery.
+    char **all;
+    //! Długość ciągu, z którego usuwane są powtórzenia.
+    size_t dedup_amount;
+    //! Liczba fragmentów przy usuwaniu powtórzeń.
+    size_t dedup_tasks;
+    //! Czy któremuś zadaniu nie udało się alokować pamięci.
+    bool failed;
+    //! Chroni pole failed.
+    pthread_mutex_t failed_mutex;
+} ParallelReverse;
+
+/** @brief Wykonuje zlecenie w puli wątków i czeka na wykonanie wszystkich zadań.
+ * Wątek zlecający również wykonuje zadania.
+ * @param pool - wskaźnik na pulę wątków.
+ * @param job - funkcja wykonująca zadanie.
+ * @param arg - argument funkcji.
+ * @param task_amount - liczba zadań.
+ */
+static void poolRun(PhoneForwardThreadPool *pool, void (*job)(void *, size_t), void *arg, size_t task_amount);
+
+/** @brief Wyznacza przekierowanie numeru bez alokowania pamięci.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param num - wskaźnik na prawidłowy numer.
+ * @param deepest_found - wskaźnik, pod który jest zapisywana długość najdłuższego pasującego prefiksu.
+ * @return Wskaźnik na przekierowanie najdłuższego pasującego prefiksu lub NULL, jeżeli numer nie jest przekierowany.
+ */
+static const char *phfwdResolve(PhoneForward const *pf, const char *num, size_t *deepest_found);
+
+/** @brief Zwiększa licznik odwiedzin węzła.
+ * Licznik jest zwiększany atomowo, bo zapytania mogą być wykonywane współbieżnie z wielu wątków.
+ * @param pf - wskaźnik na odwiedzony węzeł.
+ */
+static inline void phfwdCountHit(PhoneForward const *pf);
+
+/** @brief Sprawdza, czy przekierowaniem numeru @p x jest numer @p num, bez alokowania pamięci.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param x - wskaźnik na prawidłowy numer.
+ * @param num - wskaźnik na prawidłowy numer.
+ * @return Wartość @p true, jeżeli phfwdGet(x) = num, lub @p false w przeciwnym wypadku.
+ */
+static bool phfwdGetsTo(PhoneForward const *pf, const char *x, const char *num);
+
+/** @brief Miesza bity 64-bitowej wartości.
+ * @param x - mieszana wartość.
+ * @return Wymieszana wartość.
+ */
+static uint64_t hashMix(uint64_t x);
+
+/** @brief Wyznacza skrót numeru telefonu.
+ * @param num - wskaźnik na numer.
+ * @return Skrót numeru, nigdy równy 0.
+ */
+static uint64_t numHash(const char *num);
+
+/** @brief Wyznacza skrót poddrzewa na podstawie przekierowania węzła i skrótów jego dzieci.
+ * @param pf - wskaźnik na węzeł.
+ */
+static void phfwdRehashNode(PhoneForward *pf);
+
+/** @brief Aktualizuje skróty poddrzew na ścieżce od @p pf wyznaczonej przez pierwsze @p len cyfr numeru @p num.
+ * Skróty są aktualizowane od najgłębszego węzła do @p pf włącznie. Ścieżka może kończyć się wcześniej, jeżeli
+ * któregoś węzła na niej brakuje.
+ * @param pf - wskaźnik na węzeł początkowy.
+ * @param num - wskaźnik na numer wyznaczający ścieżkę.
+ * @param len - długość ścieżki.
+ */
+static void phfwdRehashPath(PhoneForward *pf, const char *num, size_t len);
+
 static bool numDigitIsCorrect(char c) {
-    if ((c >= '0' && c <= '9') || c == '*' || c == '#') return true;
-    return false;
+    return PHONE_NUMBER_DIGIT_INDEX[(unsigned char) c] != 0;
 }
 
 static bool numIsPrefix(const char *num1, const char *num2) {
@@ -57,15 +723,7 @@ static bool numIsPrefix(const char *num1, const char *num2) {
 }
 
 static int numDigitToIndex(char c) {
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    } else if (c == '*') {
-        return 10;
-    } else if (c == '#') {
-        return 11;
-    } else {
-        return -1; //digit not correct
-    }
+    return (int) PHONE_NUMBER_DIGIT_INDEX[(unsigned char) c] - 1;
 }
 
 static size_t numlen(const char *num) {
@@ -127,6 +785,52 @@ static int invrscmporg(const void *inv1, const void *inv2) {
     return numcmp(arg1->origin, arg2->origin);
 }
 
+static uint64_t hashMix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t numHash(const char *num) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t len = numlen(num);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint64_t) (numDigitToIndex(num[i]) + 1)) * 0x100000001b3ULL;
+    }
+    h = hashMix(h ^ len);
+    return h == 0 ? 1 : h;
+}
+
+static void phfwdRehashNode(PhoneForward *pf) {
+    // Przekierowanie leży w puli numerów, która przechowuje jego skrót, więc nie wyznaczamy go ponownie.
+    uint64_t h = pf->redirection == NULL ? 0 : targetEntry(pf->redirection)->hash;
+    bool empty = pf->redirection == NULL;
+
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        if (pf->next[i] != NULL && pf->next[i]->hash != 0) {
+            h = hashMix(h ^ (pf->next[i]->hash + (uint64_t) (i + 1) * 0x9e3779b97f4a7c15ULL));
+            empty = false;
+        }
+    }
+
+    if (empty) {
+        pf->hash = 0;
+    } else {
+        pf->hash = h == 0 ? 1 : h;
+    }
+}
+
+static void phfwdRehashPath(PhoneForward *pf, const char *num, size_t len) {
+    if (len > 0) {
+        PhoneForward *next = pf->next[numDigitToIndex(num[0])];
+        if (next != NULL) phfwdRehashPath(next, num + 1, len - 1);
+    }
+    phfwdRehashNode(pf);
+}
+
 static bool numIsCorrect(const char *num) {
     if (num == NULL) return false;
     if (numlen(num) == 0) return false;
@@ -134,32 +838,248 @@ static bool numIsCorrect(const char *num) {
     return true;
 }
 
-PhoneForward *phfwdNew(void) {
-    PhoneForward *newphfwd = malloc(sizeof(PhoneForward));
-    if (newphfwd == NULL) return NULL;
+static void *phfwdDefaultAlloc(void *ctx, size_t size) {
+    (void) ctx;
+    return malloc(size);
+}
 
-    newphfwd->next = malloc(PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
-    if (newphfwd->next == NULL) {
-        free(newphfwd);
+static void *phfwdDefaultRealloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    (void) ctx;
+    (void) old_size;
+    return realloc(ptr, new_size);
+}
+
+static void phfwdDefaultFree(void *ctx, void *ptr, size_t size) {
+    (void) ctx;
+    (void) size;
+    free(ptr);
+}
+
+static inline void *memAlloc(const PhoneForwardAllocator *allocator, size_t size) {
+    return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *memRealloc(const PhoneForwardAllocator *allocator, void *ptr, size_t old_size, size_t new_size) {
+    return allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+}
+
+static inline void memFree(const PhoneForwardAllocator *allocator, void *ptr, size_t size) {
+    allocator->free(allocator->ctx, ptr, size);
+}
+
+static TargetPool *targetPoolNew(const PhoneForwardAllocator *allocator) {
+    TargetPool *pool = memAlloc(allocator, sizeof(TargetPool));
+    if (pool == NULL) return NULL;
+
+    pool->allocator = allocator;
+    pool->target_amount = 0;
+    pool->merged = 0;
+    pool->bucket_amount = 16;
+    pool->buckets = memAlloc(allocator, pool->bucket_amount * sizeof(PhoneTarget *));
+    if (pool->buckets == NULL) {
+        memFree(allocator, pool, sizeof(TargetPool));
         return NULL;
     }
+    for (size_t i = 0; i < pool->bucket_amount; i++) {
+        pool->buckets[i] = NULL;
+    }
+    return pool;
+}
 
-    newphfwd->inversion_amount = 0;
-    newphfwd->inversion_capacity = 1;
-    newphfwd->inversions = malloc(sizeof(Inversion *));
-    if (newphfwd->inversions == NULL) {
-        free(newphfwd->next);
-        free(newphfwd);
-        return NULL;
+static void targetPoolDelete(TargetPool *pool) {
+    if (pool == NULL) return;
+
+    for (size_t i = 0; i < pool->bucket_amount; i++) {
+        PhoneTarget *target = pool->buckets[i];
+        while (target != NULL) {
+            PhoneTarget *next = target->next;
+            memFree(pool->allocator, target, sizeof(PhoneTarget) + numlen(target->number) + 1);
+            target = next;
+        }
+    }
+    memFree(pool->allocator, pool->buckets, pool->bucket_amount * sizeof(PhoneTarget *));
+    memFree(pool->allocator, pool, sizeof(TargetPool));
+}
+
+static char *targetIntern(TargetPool *pool, const char *num) {
+    uint64_t hash = numHash(num);
+    for (PhoneTarget *target = pool->buckets[targetBucket(pool, hash)]; target != NULL; target = target->next) {
+        if (target->hash == hash && numcmp(target->number, num) == 0) {
+            target->refcount++;
+            return target->number;
+        }
+    }
+
+    if (pool->target_amount >= pool->bucket_amount) {
+        size_t new_amount = pool->bucket_amount * 2;
+        PhoneTarget **new_buckets = memAlloc(pool->allocator, new_amount * sizeof(PhoneTarget *));
+        // Jeżeli nie udało się powiększyć tablicy, to pula dalej działa poprawnie, tylko z dłuższymi łańcuchami.
+        if (new_buckets != NULL) {
+            for (size_t i = 0; i < new_amount; i++) {
+                new_buckets[i] = NULL;
+            }
+            for (size_t i = 0; i < pool->bucket_amount; i++) {
+                PhoneTarget *target = pool->buckets[i];
+                while (target != NULL) {
+                    PhoneTarget *next = target->next;
+                    target->next = new_buckets[target->hash & (new_amount - 1)];
+                    new_buckets[target->hash & (new_amount - 1)] = target;
+                    target = next;
+                }
+            }
+            memFree(pool->allocator, pool->buckets, pool->bucket_amount * sizeof(PhoneTarget *));
+            pool->buckets = new_buckets;
+            pool->bucket_amount = new_amount;
+            pool->merged = 0;
+        }
+    }
+
+    PhoneTarget *target = memAlloc(pool->allocator, sizeof(PhoneTarget) + numlen(num) + 1);
+    if (target == NULL) return NULL;
+
+    target->refcount = 1;
+    target->hash = hash;
+    numcpy(target->number, num);
+    target->next = pool->buckets[targetBucket(pool, hash)];
+    pool->buckets[targetBucket(pool, hash)] = target;
+    pool->target_amount++;
+    return target->number;
+}
+
+static inline PhoneTarget *targetEntry(char *target) {
+    return (PhoneTarget *) (target - offsetof(PhoneTarget, number));
+}
+
+static void targetRelease(TargetPool *pool, char *target) {
+    PhoneTarget *entry = targetEntry(target);
+    if (--entry->refcount > 0) return;
+
+    PhoneTarget **it = &pool->buckets[targetBucket(pool, entry->hash)];
+    while (*it != entry) it = &(*it)->next;
+    *it = entry->next;
+    pool->target_amount--;
+    memFree(pool->allocator, entry, sizeof(PhoneTarget) + numlen(entry->number) + 1);
+}
+
+static inline size_t targetBucket(const TargetPool *pool, uint64_t hash) {
+    size_t index = hash & (pool->bucket_amount - 1);
+    size_t half = pool->bucket_amount / 2;
+    if (index >= half && index - half < pool->merged) index -= half;
+    return index;
+}
+
+static bool targetPoolShrink(TargetPool *pool, size_t *budget, size_t *reclaimed) {
+    while (pool->merged > 0 || (pool->bucket_amount > 16 && pool->target_amount < pool->bucket_amount / 4)) {
+        size_t half = pool->bucket_amount / 2;
+        while (pool->merged < half) {
+            if (*budget == 0) return false;
+            (*budget)--;
+
+            PhoneTarget *upper = pool->buckets[pool->merged + half];
+            if (upper != NULL) {
+                PhoneTarget *tail = upper;
+                while (tail->next != NULL) tail = tail->next;
+                tail->next = pool->buckets[pool->merged];
+                pool->buckets[pool->merged] = upper;
+                pool->buckets[pool->merged + half] = NULL;
+            }
+            pool->merged++;
+        }
+
+        // Górna połowa jest już pusta. Jeżeli nie udało się jej zwolnić, to tablica pozostaje w stanie po scaleniu,
+        // w którym targetBucket nadal wskazuje właściwe kubełki, a zwolnienie zostanie ponowione w kolejnym
+        // przejściu.
+        size_t old_size = pool->bucket_amount * sizeof(PhoneTarget *);
+        PhoneTarget **new_buckets = memRealloc(pool->allocator, pool->buckets, old_size, half * sizeof(PhoneTarget *));
+        if (new_buckets == NULL) return true;
+        *reclaimed += half * sizeof(PhoneTarget *);
+        pool->buckets = new_buckets;
+        pool->bucket_amount = half;
+        pool->merged = 0;
     }
+    return true;
+}
+
+static inline PhoneForwardRoot *phfwdRoot(PhoneForward *pf) {
+    return (PhoneForwardRoot *) pf;
+}
+
+static inline const PhoneForwardRoot *phfwdRootConst(PhoneForward const *pf) {
+    return (const PhoneForwardRoot *) pf;
+}
+
+static bool phfwdNodeInit(PhoneForward *pf, const PhoneForwardAllocator *allocator) {
+    pf->next = memAlloc(allocator, PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+    if (pf->next == NULL) return false;
 
     for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
-        newphfwd->next[i] = NULL;
+        pf->next[i] = NULL;
+    }
+    pf->redirection = NULL;
+    pf->inversion = NULL;
+    pf->hash = 0;
+    pf->hits = 0;
+    return true;
+}
+
+static PhoneForward *phfwdNodeNew(const PhoneForwardAllocator *allocator) {
+    PhoneForward *newphfwd = memAlloc(allocator, sizeof(PhoneForward));
+    if (newphfwd == NULL) return NULL;
+
+    if (!phfwdNodeInit(newphfwd, allocator)) {
+        memFree(allocator, newphfwd, sizeof(PhoneForward));
+        return NULL;
     }
-    newphfwd->redirection = NULL;
     return newphfwd;
 }
 
+PhoneForward *phfwdNew(void) {
+    PhoneForwardAllocator allocator = {phfwdDefaultAlloc, phfwdDefaultRealloc, phfwdDefaultFree, NULL};
+    return phfwdNewWithAllocator(&allocator);
+}
+
+PhoneForward *phfwdNewWithAllocator(PhoneForwardAllocator const *allocator) {
+    if (allocator == NULL || allocator->alloc == NULL || allocator->realloc == NULL || allocator->free == NULL) {
+        return NULL;
+    }
+
+    PhoneForwardAllocator *own = memAlloc(allocator, sizeof(PhoneForwardAllocator));
+    if (own == NULL) return NULL;
+    *own = *allocator;
+
+    PhoneForwardRoot *root = memAlloc(own, sizeof(PhoneForwardRoot));
+    if (root == NULL) {
+        memFree(allocator, own, sizeof(PhoneForwardAllocator));
+        return NULL;
+    }
+    if (!phfwdNodeInit(&root->node, own)) {
+        memFree(own, root, sizeof(PhoneForwardRoot));
+        memFree(allocator, own, sizeof(PhoneForwardAllocator));
+        return NULL;
+    }
+    root->allocator = own;
+    root->inversion_amount = 0;
+    root->inversions_sorted = true;
+    root->profiling = false;
+    root->targets = NULL;
+    root->packed = NULL;
+
+    root->inversion_capacity = 1;
+    root->inversions = memAlloc(own, sizeof(Inversion *));
+    if (root->inversions == NULL) {
+        root->inversion_capacity = 0;
+        phfwdDelete(&root->node);
+        return NULL;
+    }
+
+    root->targets = targetPoolNew(own);
+    if (root->targets == NULL) {
+        phfwdDelete(&root->node);
+        return NULL;
+    }
+    return &root->node;
+}
+
 Inversion *invrsNew(const char *num_forward, const char *num_origin) {
     if (!numIsCorrect(num_forward) || !numIsCorrect(num_origin)) return NULL;
     Inversion *newinvrs = malloc(sizeof(Inversion));
@@ -183,8 +1103,25 @@ Inversion *invrsNew(const char *num_forward, const char *num_origin) {
     return newinvrs;
 }
 
+static Inversion *invrsNewPooled(char *forward, const char *num_origin, const PhoneForwardAllocator *allocator) {
+    if (!numIsCorrect(num_origin)) return NULL;
+    Inversion *newinvrs = memAlloc(allocator, sizeof(Inversion));
+    if (newinvrs == NULL) return NULL;
+
+    newinvrs->origin = memAlloc(allocator, numlen(num_origin) + 1);
+    if (newinvrs->origin == NULL) {
+        memFree(allocator, newinvrs, sizeof(Inversion));
+        return NULL;
+    }
+
+    newinvrs->forward = forward;
+    numcpy(newinvrs->origin, num_origin);
+    return newinvrs;
+}
+
 PhoneNumbers *phfwdReverse(PhoneForward const *pf, char const *num) {
     if (pf == NULL) return NULL;
+    const PhoneForwardRoot *root = phfwdRootConst(pf);
 
     PhoneNumbers *pnum = malloc(sizeof(PhoneNumbers));
     if (pnum == NULL) return NULL;
@@ -209,15 +1146,15 @@ PhoneNumbers *phfwdReverse(PhoneForward const *pf, char const *num) {
         phnumDelete(pnum);
         return NULL;
     }
-    for (size_t i = 0; i < pf->inversion_amount; i++) {
-        if (numIsPrefix(pf->inversions[i]->forward, num)) {
-            c = realloc(c, numlen(pf->inversions[i]->origin) + numlen(num) - numlen(pf->inversions[i]->forward) + 1);
+    for (size_t i = 0; i < root->inversion_amount; i++) {
+        if (numIsPrefix(root->inversions[i]->forward, num)) {
+            c = realloc(c, numlen(root->inversions[i]->origin) + numlen(num) - numlen(root->inversions[i]->forward) + 1);
             if (c == NULL) {
                 phnumDelete(pnum);
                 return NULL;
             }
-            numcpy(c, pf->inversions[i]->origin);
-            numcat(c, num + numlen(pf->inversions[i]->forward));
+            numcpy(c, root->inversions[i]->origin);
+            numcat(c, num + numlen(root->inversions[i]->forward));
             if (!phnumAdd(pnum, c)) {
                 phnumDelete(pnum);
                 free(c);
@@ -314,22 +1251,59 @@ PhoneNumbers *phfwdGetReverse(PhoneForward const *pf, char const *num) {
     return res;
 }
 
-void phfwdDelete(PhoneForward *pf) {
+static bool phfwdIsPacked(const PhoneForwardPacked *packed, const PhoneForward *pf) {
+    if (packed == NULL) return false;
+    // Porównujemy adresy całkowitoliczbowo, bo węzeł nie musi należeć do bloku.
+    uintptr_t begin = (uintptr_t) packed->nodes;
+    uintptr_t end = (uintptr_t) (packed->nodes + packed->amount);
+    return (uintptr_t) pf >= begin && (uintptr_t) pf < end;
+}
+
+static size_t phfwdDeleteNode(PhoneForward *pf, TargetPool *targets, const PhoneForwardPacked *packed) {
     if (pf == NULL) {
-        return;
+        return 0;
     }
+    size_t freed = 0;
     for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
-        phfwdDelete(pf->next[i]);
+        freed += phfwdDeleteNode(pf->next[i], targets, packed);
     }
-    free(pf->next);
-    free(pf->redirection);
+    if (pf->redirection != NULL) targetRelease(targets, pf->redirection);
+    if (phfwdIsPacked(packed, pf)) return freed;
+    memFree(targets->allocator, pf->next, PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+    memFree(targets->allocator, pf, sizeof(PhoneForward));
+    return freed + sizeof(PhoneForward) + PHONE_NUMBER_DIGITS * sizeof(PhoneForward *);
+}
 
-    for (size_t i = 0; i < pf->inversion_amount; i++) {
-        invrsDelete(pf->inversions[i]);
+void phfwdDelete(PhoneForward *pf) {
+    if (pf == NULL) {
+        return;
+    }
+    PhoneForwardRoot *root = phfwdRoot(pf);
+    PhoneForwardAllocator *allocator = root->allocator;
+    for (size_t i = 0; i < root->inversion_amount; i++) {
+        invrsDeletePooled(root->inversions[i], allocator);
+    }
+    if (root->inversions != NULL) memFree(allocator, root->inversions, root->inversion_capacity * sizeof(Inversion *));
+
+    // Węzły mogą istnieć bez puli tylko wtedy, gdy nie udało się jej utworzyć w phfwdNewWithAllocator, a wtedy
+    // korzeń nie ma dzieci ani przekierowania.
+    TargetPool *targets = root->targets;
+    PhoneForwardPacked *packed = root->packed;
+    if (targets != NULL) {
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            phfwdDeleteNode(pf->next[i], targets, packed);
+        }
+        if (pf->redirection != NULL) targetRelease(targets, pf->redirection);
+        targetPoolDelete(targets);
+        if (packed != NULL) {
+            memFree(allocator, packed, sizeof(PhoneForwardPacked) + packed->amount * sizeof(PhoneForwardPackedNode));
+        }
     }
-    free(pf->inversions);
+    memFree(allocator, pf->next, PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+    memFree(allocator, root, sizeof(PhoneForwardRoot));
 
-    free(pf);
+    PhoneForwardAllocator own = *allocator;
+    memFree(&own, allocator, sizeof(PhoneForwardAllocator));
 }
 
 void invrsDelete(Inversion *inv) {
@@ -341,64 +1315,88 @@ void invrsDelete(Inversion *inv) {
     free(inv);
 }
 
+static void invrsDeletePooled(Inversion *inv, const PhoneForwardAllocator *allocator) {
+    if (inv == NULL) {
+        return;
+    }
+    memFree(allocator, inv->origin, numlen(inv->origin) + 1);
+    memFree(allocator, inv, sizeof(Inversion));
+}
+
 bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2) {
     if (pf == NULL || !numIsCorrect(num1) || !numIsCorrect(num2) || numcmp(num1, num2) == 0) return false;
 
     PhoneForward *pf_origin = pf;
+    PhoneForwardRoot *root = phfwdRoot(pf);
     size_t num1_len = numlen(num1);
     for (size_t num1_it = 0; num1_it < num1_len; num1_it++) {
         int index = numDigitToIndex(num1[num1_it]);
-        if (pf->next[index] == NULL) pf->next[index] = phfwdNew();
+        if (pf->next[index] == NULL) pf->next[index] = phfwdNodeNew(root->allocator);
         if (pf->next[index] == NULL) return false;
         pf = pf->next[index];
     }
-    if (pf->redirection == NULL) {
-        pf->redirection = malloc((numlen(num2) + 1));
-        if (pf->redirection == NULL) return false;
-    } else {
-        char *new_redirection = realloc(pf->redirection, numlen(num2) + 1);
-        if (new_redirection == NULL) return false;
-        pf->redirection = new_redirection;
-    }
 
-    numcpy(pf->redirection, num2);
+    char *target = targetIntern(root->targets, num2);
+    if (target == NULL) return false;
 
-    if (pf_origin->inversion_amount >= pf_origin->inversion_capacity) {
-        pf_origin->inversion_capacity *= 2;
-        Inversion **new_inversions = realloc(pf_origin->inversions,
-                                             pf_origin->inversion_capacity * sizeof(Inversion *));
+    // Zastąpienie przekierowania nie zmienia źródła, więc wystarczy podmienić numer w istniejącej inwersji.
+    if (pf->redirection != NULL) {
+        targetRelease(root->targets, pf->redirection);
+        pf->redirection = target;
+        pf->inversion->forward = target;
+        phfwdRehashPath(pf_origin, num1, num1_len);
+        return true;
+    }
+
+    if (root->inversion_amount >= root->inversion_capacity) {
+        Inversion **new_inversions = memRealloc(root->allocator, root->inversions,
+                                                root->inversion_capacity * sizeof(Inversion *),
+                                                2 * root->inversion_capacity * sizeof(Inversion *));
 
         if (new_inversions == NULL) {
-            pf_origin->inversion_capacity /= 2;
-            free(pf->redirection);
-            pf->redirection = NULL;
+            targetRelease(root->targets, target);
             return false;
         }
-        pf_origin->inversions = new_inversions;
+        root->inversions = new_inversions;
+        root->inversion_capacity *= 2;
     }
 
-    pf_origin->inversions[pf_origin->inversion_amount] = invrsNew(num2, num1);
-    if (pf_origin->inversions[pf_origin->inversion_amount] == NULL) {
-        free(pf->redirection);
-        pf->redirection = NULL;
+    Inversion *inversion = invrsNewPooled(target, num1, root->allocator);
+    if (inversion == NULL) {
+        targetRelease(root->targets, target);
         return false;
     }
-    qsort(pf->inversions, pf->inversion_amount, sizeof(Inversion *), invrscmporg);
 
-    pf_origin->inversion_amount++;
+    // Inwersje są sortowane dopiero wtedy, gdy są potrzebne w kolejności, czyli przy usuwaniu przekierowań.
+    if (root->inversion_amount > 0 &&
+        numcmp(root->inversions[root->inversion_amount - 1]->origin, num1) > 0) {
+        root->inversions_sorted = false;
+    }
+    root->inversions[root->inversion_amount] = inversion;
+    root->inversion_amount++;
+
+    pf->redirection = target;
+    pf->inversion = inversion;
+    phfwdRehashPath(pf_origin, num1, num1_len);
     return true;
 }
 
 void phfwdRemove(PhoneForward *pf, char const *num) {
     if (!numIsCorrect(num) || pf == NULL) return;
 
+    PhoneForwardRoot *root = phfwdRoot(pf);
+    if (!root->inversions_sorted) {
+        qsort(root->inversions, root->inversion_amount, sizeof(Inversion *), invrscmporg);
+        root->inversions_sorted = true;
+    }
+
     size_t l = 0;
-    size_t r = pf->inversion_amount;
+    size_t r = root->inversion_amount;
     size_t m;
 
     while (l < r) {
         m = (l + r) / 2;
-        if (numcmp(num, pf->inversions[m]->origin) > 0) {
+        if (numcmp(num, root->inversions[m]->origin) > 0) {
             l = m + 1;
         } else {
             r = m;
@@ -407,19 +1405,20 @@ void phfwdRemove(PhoneForward *pf, char const *num) {
 
     size_t first_index = l;
 
-    while (l < pf->inversion_amount && numIsPrefix(num, pf->inversions[l]->origin)) {
-        invrsDelete(pf->inversions[l]);
+    while (l < root->inversion_amount && numIsPrefix(num, root->inversions[l]->origin)) {
+        invrsDeletePooled(root->inversions[l], root->allocator);
         l++;
     }
 
     size_t removed_inversions = l - first_index;
 
-    for (size_t i = 0; l + i < pf->inversion_amount; i++) {
-        pf->inversions[first_index + i] = pf->inversions[l + i];
+    for (size_t i = 0; l + i < root->inversion_amount; i++) {
+        root->inversions[first_index + i] = root->inversions[l + i];
     }
 
-    pf->inversion_amount -= removed_inversions;
+    root->inversion_amount -= removed_inversions;
 
+    PhoneForward *pf_origin = pf;
     size_t num_len = numlen(num);
     for (size_t num_it = 0; num_it < num_len - 1; num_it++) {
         int index = numDigitToIndex(num[num_it]);
@@ -427,74 +1426,133 @@ void phfwdRemove(PhoneForward *pf, char const *num) {
         pf = pf->next[index];
     }
     int index = numDigitToIndex(num[num_len - 1]);
-    phfwdDelete(pf->next[index]);
+    phfwdDeleteNode(pf->next[index], root->targets, root->packed);
     pf->next[index] = NULL;
+    phfwdRehashPath(pf_origin, num, num_len - 1);
 }
 
-PhoneNumbers *phfwdGet(PhoneForward const *pf, char const *num) {
-    if (pf == NULL) return NULL;
-    if (!numIsCorrect(num)) {
-        PhoneNumbers *res = malloc(sizeof(PhoneNumbers));
-        if (res == NULL) return NULL;
-
-        res->number_amount = 0;
-        res->number_capacity = 1;
-        res->numbers = malloc(sizeof(char *));
-        if (res->numbers == NULL) {
-            free(res);
-            return NULL;
-        }
-        return res;
+static PhoneNumbers *phnumNewForward(const char *redirection, const char *num, size_t deepest_found) {
+    PhoneNumbers *res = phnumNew();
+    if (res == NULL) return NULL;
+
+    if (redirection == NULL) {
+        res->numbers[0] = malloc(numlen(num) + 1);
+        if (res->numbers[0] == NULL) {
+            phnumDelete(res);
+            return NULL;
+        }
+        numcpy(res->numbers[0], num);
+    } else {
+        res->numbers[0] = malloc(numlen(redirection) + numlen(num + deepest_found) + 1);
+        if (res->numbers[0] == NULL) {
+            phnumDelete(res);
+            return NULL;
+        }
+        numcpy(res->numbers[0], redirection);
+        numcat(res->numbers[0], num + deepest_found);
     }
+    res->number_amount = 1;
+    return res;
+}
 
-    size_t num_len = numlen(num);
-    size_t deepest_found = 0;
-    PhoneForward pf_it = *pf;
+PhoneNumbers *phfwdGet(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) return NULL;
+    if (!numIsCorrect(num)) return phnumNew();
 
-    for (size_t num_it = 0; num_it <= num_len; num_it++) {
-        if (pf_it.redirection != NULL) {
+    const char *redirection = NULL;
+    size_t deepest_found = 0;
+    bool profiling = phfwdRootConst(pf)->profiling;
+    for (size_t num_it = 0; pf != NULL; num_it++) {
+        if (profiling) phfwdCountHit(pf);
+        if (pf->redirection != NULL) {
+            redirection = pf->redirection;
             deepest_found = num_it;
         }
-        int index = numDigitToIndex(num[num_it]);
-        if (num_it == num_len || pf_it.next[index] == NULL) break;
-        pf_it = *pf_it.next[index];
+        if (num[num_it] == '\0') break;
+        pf = pf->next[numDigitToIndex(num[num_it])];
     }
-    PhoneNumbers *res = malloc(sizeof(PhoneNumbers));
-    if (res == NULL) return NULL;
+    return phnumNewForward(redirection, num, deepest_found);
+}
 
-    res->number_amount = 1;
-    res->numbers = malloc(sizeof(char *));
-    if (res->numbers == NULL) {
-        free(res);
-        return NULL;
+bool phfwdGetBatch(PhoneForward const *pf, char const *const *nums, size_t count, PhoneNumbers **results) {
+    if (pf == NULL || (count > 0 && (nums == NULL || results == NULL))) return false;
+
+    for (size_t i = 0; i < count; i++) {
+        results[i] = NULL;
     }
 
-    if (deepest_found == 0) {
-        res->numbers[0] = malloc(numlen(num) + 1);
-        if (res->numbers[0] == NULL) {
-            free(res->numbers);
-            free(res);
-            return NULL;
+    PhoneForwardLookup lanes[PHFWD_BATCH_WIDTH];
+    size_t active = 0;
+    size_t next_query = 0;
+    bool ok = true;
+    bool profiling = phfwdRootConst(pf)->profiling;
+
+    // Każda ścieżka wykonuje jeden krok na obrót pętli: albo czyta węzeł i pobiera z wyprzedzeniem wskaźnik na
+    // dziecko, albo odczytuje ten wskaźnik i pobiera z wyprzedzeniem samo dziecko. Zanim ścieżka wróci do
+    // pobieranych danych, pozostałe ścieżki wykonują swoje kroki, więc oczekiwania na pamięć się nakładają.
+    while (ok && (active > 0 || next_query < count)) {
+        while (active < PHFWD_BATCH_WIDTH && next_query < count) {
+            size_t query = next_query++;
+            if (!numIsCorrect(nums[query])) {
+                results[query] = phnumNew();
+                if (results[query] == NULL) ok = false;
+                continue;
+            }
+            lanes[active].node = pf;
+            lanes[active].slot = NULL;
+            lanes[active].query = query;
+            lanes[active].depth = 0;
+            lanes[active].deepest_found = 0;
+            lanes[active].redirection = NULL;
+            active++;
         }
 
-        numcpy(res->numbers[0], num);
-    } else {
-        pf_it = *pf;
+        for (size_t i = 0; i < active;) {
+            PhoneForwardLookup *lane = &lanes[i];
+            bool done = false;
+
+            if (lane->slot == NULL) {
+                if (profiling) phfwdCountHit(lane->node);
+                if (lane->node->redirection != NULL) {
+                    lane->redirection = lane->node->redirection;
+                    lane->deepest_found = lane->depth;
+                }
+                char c = nums[lane->query][lane->depth];
+                if (c == '\0') {
+                    done = true;
+                } else {
+                    lane->slot = &lane->node->next[numDigitToIndex(c)];
+                    __builtin_prefetch(lane->slot);
+                }
+            } else {
+                PhoneForward const *child = *lane->slot;
+                lane->slot = NULL;
+                if (child == NULL) {
+                    done = true;
+                } else {
+                    __builtin_prefetch(child);
+                    lane->node = child;
+                    lane->depth++;
+                }
+            }
 
-        for (size_t num_it = 0; num_it < deepest_found; num_it++) {
-            pf_it = *pf_it.next[numDigitToIndex(num[num_it])];
-        }
-        res->numbers[0] = malloc(numlen(pf_it.redirection) + numlen(num + deepest_found) + 1);
-        if (res->numbers[0] == NULL) {
-            free(res->numbers);
-            free(res);
-            return NULL;
+            if (done) {
+                results[lane->query] = phnumNewForward(lane->redirection, nums[lane->query], lane->deepest_found);
+                if (results[lane->query] == NULL) ok = false;
+                lanes[i] = lanes[--active];
+            } else {
+                i++;
+            }
         }
+    }
 
-        numcpy(res->numbers[0], pf_it.redirection);
-        numcat(res->numbers[0], num + deepest_found);
+    if (!ok) {
+        for (size_t i = 0; i < count; i++) {
+            phnumDelete(results[i]);
+            results[i] = NULL;
+        }
     }
-    return res;
+    return ok;
 }
 
 void phnumDelete(PhoneNumbers *pnum) {
@@ -536,4 +1594,1342 @@ char const *phnumGet(PhoneNumbers const *pnum, size_t idx) {
     if (idx >= pnum->number_amount) return res;
     res = pnum->numbers[idx];
     return res;
+}
+
+PhoneForwardDiff *phfwdDiffNew(PhoneForward const *pf_old, PhoneForward const *pf_new) {
+    if (pf_old == NULL || pf_new == NULL) return NULL;
+
+    PhoneForwardDiff *diff = malloc(sizeof(PhoneForwardDiff));
+    if (diff == NULL) return NULL;
+
+    diff->capacity = 16;
+    diff->stack = malloc(diff->capacity * sizeof(PhoneForwardDiffFrame));
+    if (diff->stack == NULL) {
+        free(diff);
+        return NULL;
+    }
+    diff->prefix = malloc(diff->capacity + 1);
+    if (diff->prefix == NULL) {
+        free(diff->stack);
+        free(diff);
+        return NULL;
+    }
+
+    diff->prefix[0] = '\0';
+    diff->depth = 0;
+    diff->failed = false;
+    if (pf_old != pf_new && pf_old->hash != pf_new->hash) {
+        diff->stack[0].old_node = pf_old;
+        diff->stack[0].new_node = pf_new;
+        diff->stack[0].child = -1;
+        diff->depth = 1;
+    }
+    return diff;
+}
+
+bool phfwdDiffNext(PhoneForwardDiff *diff, char const **num, char const **old_fwd, char const **new_fwd) {
+    if (diff == NULL || diff->failed) return false;
+
+    while (diff->depth > 0) {
+        PhoneForwardDiffFrame *frame = &diff->stack[diff->depth - 1];
+        const char *old_redirection = frame->old_node == NULL ? NULL : frame->old_node->redirection;
+        const char *new_redirection = frame->new_node == NULL ? NULL : frame->new_node->redirection;
+
+        if (frame->child < 0) {
+            frame->child = 0;
+            bool differ = (old_redirection == NULL) != (new_redirection == NULL) ||
+                          (old_redirection != NULL && numcmp(old_redirection, new_redirection) != 0);
+            if (differ) {
+                diff->prefix[diff->depth - 1] = '\0';
+                if (num != NULL) *num = diff->prefix;
+                if (old_fwd != NULL) *old_fwd = old_redirection;
+                if (new_fwd != NULL) *new_fwd = new_redirection;
+                return true;
+            }
+        }
+
+        PhoneForward const *old_child = NULL;
+        PhoneForward const *new_child = NULL;
+        while (frame->child < PHONE_NUMBER_DIGITS) {
+            old_child = frame->old_node == NULL ? NULL : frame->old_node->next[frame->child];
+            new_child = frame->new_node == NULL ? NULL : frame->new_node->next[frame->child];
+            uint64_t old_hash = old_child == NULL ? 0 : old_child->hash;
+            uint64_t new_hash = new_child == NULL ? 0 : new_child->hash;
+            if (old_child != new_child && old_hash != new_hash) break;
+            frame->child++;
+        }
+
+        if (frame->child == PHONE_NUMBER_DIGITS) {
+            diff->depth--;
+            continue;
+        }
+
+        if (diff->depth >= diff->capacity) {
+            size_t new_capacity = diff->capacity * 2;
+            PhoneForwardDiffFrame *new_stack = realloc(diff->stack, new_capacity * sizeof(PhoneForwardDiffFrame));
+            if (new_stack == NULL) {
+                diff->failed = true;
+                return false;
+            }
+            diff->stack = new_stack;
+            char *new_prefix = realloc(diff->prefix, new_capacity + 1);
+            if (new_prefix == NULL) {
+                diff->failed = true;
+                return false;
+            }
+            diff->prefix = new_prefix;
+            diff->capacity = new_capacity;
+            frame = &diff->stack[diff->depth - 1];
+        }
+
+        diff->prefix[diff->depth - 1] = PHONE_NUMBER_DIGIT_CHARS[frame->child];
+        frame->child++;
+        diff->stack[diff->depth].old_node = old_child;
+        diff->stack[diff->depth].new_node = new_child;
+        diff->stack[diff->depth].child = -1;
+        diff->depth++;
+    }
+    return false;
+}
+
+bool phfwdDiffFailed(PhoneForwardDiff const *diff) {
+    return diff != NULL && diff->failed;
+}
+
+void phfwdDiffDelete(PhoneForwardDiff *diff) {
+    if (diff == NULL) return;
+
+    free(diff->stack);
+    free(diff->prefix);
+    free(diff);
+}
+
+static PhoneNumbers *phnumNew(void) {
+    PhoneNumbers *pnum = malloc(sizeof(PhoneNumbers));
+    if (pnum == NULL) return NULL;
+
+    pnum->number_amount = 0;
+    pnum->number_capacity = 1;
+    pnum->numbers = malloc(sizeof(char *));
+    if (pnum->numbers == NULL) {
+        free(pnum);
+        return NULL;
+    }
+    return pnum;
+}
+
+static uint32_t frozenPoolIntern(FrozenPoolBuilder *builder, const char *num) {
+    size_t mask = builder->slot_amount - 1;
+    size_t slot = numHash(num) & mask;
+    while (builder->slots[slot] != FROZEN_NONE) {
+        if (numcmp(builder->pool + builder->slots[slot], num) == 0) return builder->slots[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    size_t len = numlen(num);
+    if (builder->size + len + 1 >= FROZEN_NONE) return FROZEN_NONE;
+    if (builder->size + len + 1 > builder->capacity) {
+        size_t new_capacity = builder->capacity * 2;
+        while (new_capacity < builder->size + len + 1) new_capacity *= 2;
+        char *new_pool = realloc(builder->pool, new_capacity);
+        if (new_pool == NULL) return FROZEN_NONE;
+        builder->pool = new_pool;
+        builder->capacity = new_capacity;
+    }
+
+    uint32_t offset = (uint32_t) builder->size;
+    numcpy(builder->pool + offset, num);
+    builder->size += len + 1;
+    builder->slots[slot] = offset;
+    builder->slot_used++;
+
+    if (2 * builder->slot_used > builder->slot_amount) {
+        size_t new_amount = builder->slot_amount * 2;
+        uint32_t *new_slots = malloc(new_amount * sizeof(uint32_t));
+        if (new_slots == NULL) return FROZEN_NONE;
+        for (size_t i = 0; i < new_amount; i++) new_slots[i] = FROZEN_NONE;
+        for (size_t i = 0; i < builder->slot_amount; i++) {
+            if (builder->slots[i] == FROZEN_NONE) continue;
+            size_t new_slot = numHash(builder->pool + builder->slots[i]) & (new_amount - 1);
+            while (new_slots[new_slot] != FROZEN_NONE) new_slot = (new_slot + 1) & (new_amount - 1);
+            new_slots[new_slot] = builder->slots[i];
+        }
+        free(builder->slots);
+        builder->slots = new_slots;
+        builder->slot_amount = new_amount;
+    }
+    return offset;
+}
+
+static int frozenInvrsCmp(const PhoneForwardFrozenInversion *inv1, const PhoneForwardFrozenInversion *inv2,
+                          const char *pool) {
+    int res = numcmp(pool + inv1->forward, pool + inv2->forward);
+    if (res != 0) return res;
+    return numcmp(pool + inv1->origin, pool + inv2->origin);
+}
+
+static int frozenPrefixCmp(const char *pool_num, const char *num, size_t len) {
+    size_t i = 0;
+    while (i < len && pool_num[i] != '\0') {
+        if (numDigitToIndex(pool_num[i]) > numDigitToIndex(num[i])) return 1;
+        if (numDigitToIndex(pool_num[i]) < numDigitToIndex(num[i])) return -1;
+        i++;
+    }
+    if (pool_num[i] != '\0') return 1;
+    if (i < len) return -1;
+    return 0;
+}
+
+/** @brief Sortuje inwersje zamrożonej struktury.
+ * Sortowanie przez scalanie, ponieważ qsort nie pozwala przekazać puli napisów do komparatora.
+ * @param inv - wskaźnik na sortowane inwersje.
+ * @param tmp - wskaźnik na bufor pomocniczy o tym samym rozmiarze.
+ * @param amount - liczba inwersji.
+ * @param pool - wskaźnik na pulę napisów.
+ */
+static void frozenInvrsSort(PhoneForwardFrozenInversion *inv, PhoneForwardFrozenInversion *tmp, size_t amount,
+                            const char *pool) {
+    if (amount < 2) return;
+    size_t half = amount / 2;
+    frozenInvrsSort(inv, tmp, half, pool);
+    frozenInvrsSort(inv + half, tmp, amount - half, pool);
+
+    size_t l = 0, r = half, it = 0;
+    while (l < half && r < amount) {
+        if (frozenInvrsCmp(&inv[r], &inv[l], pool) < 0) {
+            tmp[it++] = inv[r++];
+        } else {
+            tmp[it++] = inv[l++];
+        }
+    }
+    while (l < half) tmp[it++] = inv[l++];
+    while (r < amount) tmp[it++] = inv[r++];
+    for (size_t i = 0; i < amount; i++) inv[i] = tmp[i];
+}
+
+PhoneForwardFrozen *phfwdFreeze(PhoneForward const *pf) {
+    if (pf == NULL) return NULL;
+    const PhoneForwardRoot *root = phfwdRootConst(pf);
+
+    PhoneForwardFrozen *pff = calloc(1, sizeof(PhoneForwardFrozen));
+    if (pff == NULL) return NULL;
+
+    FrozenPoolBuilder builder = {0, 64, malloc(64), 64, 0, malloc(64 * sizeof(uint32_t))};
+    size_t queue_capacity = 16;
+    PhoneForward const **queue = malloc(queue_capacity * sizeof(PhoneForward *));
+    bool ok = builder.pool != NULL && builder.slots != NULL && queue != NULL;
+    if (ok) {
+        for (size_t i = 0; i < builder.slot_amount; i++) builder.slots[i] = FROZEN_NONE;
+    }
+
+    // Kolejka przechodzenia wszerz jest jednocześnie kolejnością węzłów w wynikowej tablicy, więc dzieci każdego
+    // węzła trafiają do niej kolejno, tuż za dziećmi poprzednich węzłów z tego samego poziomu.
+    size_t queue_amount = 0;
+    if (ok) queue[queue_amount++] = pf;
+    for (size_t it = 0; ok && it < queue_amount; it++) {
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            PhoneForward const *child = queue[it]->next[i];
+            if (child == NULL || child->hash == 0) continue;
+            if (queue_amount >= queue_capacity) {
+                queue_capacity *= 2;
+                PhoneForward const **new_queue = realloc(queue, queue_capacity * sizeof(PhoneForward *));
+                if (new_queue == NULL) {
+                    ok = false;
+                    break;
+                }
+                queue = new_queue;
+            }
+            queue[queue_amount++] = child;
+        }
+    }
+
+    if (ok && queue_amount >= FROZEN_NONE) ok = false;
+    if (ok) {
+        pff->node_amount = queue_amount;
+        pff->nodes = malloc(queue_amount * sizeof(PhoneForwardFrozenNode));
+        ok = pff->nodes != NULL;
+    }
+
+    size_t next_child = 1;
+    for (size_t it = 0; ok && it < queue_amount; it++) {
+        PhoneForwardFrozenNode *node = &pff->nodes[it];
+        node->first_child = (uint32_t) next_child;
+        node->children = 0;
+        node->redirection = FROZEN_NONE;
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            PhoneForward const *child = queue[it]->next[i];
+            if (child == NULL || child->hash == 0) continue;
+            node->children |= (uint16_t) (1u << i);
+            next_child++;
+        }
+        if (queue[it]->redirection != NULL) {
+            node->redirection = frozenPoolIntern(&builder, queue[it]->redirection);
+            ok = node->redirection != FROZEN_NONE;
+        }
+    }
+
+    if (ok) {
+        pff->inversion_amount = root->inversion_amount;
+        pff->inversions = malloc((root->inversion_amount + 1) * sizeof(PhoneForwardFrozenInversion));
+        ok = pff->inversions != NULL;
+    }
+    for (size_t i = 0; ok && i < root->inversion_amount; i++) {
+        pff->inversions[i].forward = frozenPoolIntern(&builder, root->inversions[i]->forward);
+        pff->inversions[i].origin = frozenPoolIntern(&builder, root->inversions[i]->origin);
+        ok = pff->inversions[i].forward != FROZEN_NONE && pff->inversions[i].origin != FROZEN_NONE;
+    }
+    if (ok) {
+        PhoneForwardFrozenInversion *tmp = malloc((root->inversion_amount + 1) * sizeof(PhoneForwardFrozenInversion));
+        ok = tmp != NULL;
+        if (ok) frozenInvrsSort(pff->inversions, tmp, pff->inversion_amount, builder.pool);
+        free(tmp);
+    }
+
+    free(queue);
+    free(builder.slots);
+    if (!ok) {
+        free(builder.pool);
+        phfwdFrozenDelete(pff);
+        return NULL;
+    }
+
+    char *pool = realloc(builder.pool, builder.size + 1);
+    pff->pool = pool == NULL ? builder.pool : pool;
+    pff->pool_size = builder.size;
+    return pff;
+}
+
+void phfwdFrozenDelete(PhoneForwardFrozen *pff) {
+    if (pff == NULL) return;
+
+    free(pff->nodes);
+    free(pff->inversions);
+    free(pff->pool);
+    free(pff);
+}
+
+size_t phfwdFrozenGetInto(PhoneForwardFrozen const *pff, char const *num, char *buf, size_t size) {
+    if (pff == NULL || !numIsCorrect(num)) return 0;
+
+    const PhoneForwardFrozenNode *nodes = pff->nodes;
+    const PhoneForwardFrozenNode *node = nodes;
+    uint32_t redirection = FROZEN_NONE;
+    size_t deepest_found = 0;
+    size_t num_it = 0;
+
+    while (true) {
+        if (node->redirection != FROZEN_NONE) {
+            redirection = node->redirection;
+            deepest_found = num_it;
+        }
+        if (num[num_it] == '\0') break;
+        unsigned index = (unsigned) numDigitToIndex(num[num_it]);
+        if (!(node->children >> index & 1u)) break;
+        node = nodes + node->first_child + __builtin_popcount(node->children & ((1u << index) - 1));
+        num_it++;
+    }
+
+    const char *prefix = redirection == FROZEN_NONE ? "" : pff->pool + redirection;
+    size_t prefix_len = numlen(prefix);
+    size_t len = prefix_len + numlen(num + deepest_found);
+
+    if (size > 0) {
+        size_t it = 0;
+        for (size_t i = 0; i < prefix_len && it + 1 < size; i++) buf[it++] = prefix[i];
+        for (const char *c = num + deepest_found; *c != '\0' && it + 1 < size; c++) buf[it++] = *c;
+        buf[it] = '\0';
+    }
+    return len;
+}
+
+PhoneNumbers *phfwdFrozenGet(PhoneForwardFrozen const *pff, char const *num) {
+    if (pff == NULL) return NULL;
+
+    PhoneNumbers *res = phnumNew();
+    if (res == NULL) return NULL;
+    if (!numIsCorrect(num)) return res;
+
+    size_t len = phfwdFrozenGetInto(pff, num, NULL, 0);
+    res->numbers[0] = malloc(len + 1);
+    if (res->numbers[0] == NULL) {
+        phnumDelete(res);
+        return NULL;
+    }
+    phfwdFrozenGetInto(pff, num, res->numbers[0], len + 1);
+    res->number_amount = 1;
+    return res;
+}
+
+PhoneNumbers *phfwdFrozenReverse(PhoneForwardFrozen const *pff, char const *num) {
+    if (pff == NULL) return NULL;
+
+    PhoneNumbers *res = phnumNew();
+    if (res == NULL) return NULL;
+    if (!numIsCorrect(num)) return res;
+
+    if (!phnumAdd(res, num)) {
+        phnumDelete(res);
+        return NULL;
+    }
+
+    size_t num_len = numlen(num);
+    for (size_t len = 1; len <= num_len; len++) {
+        size_t l = 0;
+        size_t r = pff->inversion_amount;
+        while (l < r) {
+            size_t m = (l + r) / 2;
+            if (frozenPrefixCmp(pff->pool + pff->inversions[m].forward, num, len) < 0) {
+                l = m + 1;
+            } else {
+                r = m;
+            }
+        }
+
+        for (; l < pff->inversion_amount &&
+               frozenPrefixCmp(pff->pool + pff->inversions[l].forward, num, len) == 0; l++) {
+            const char *origin = pff->pool + pff->inversions[l].origin;
+            size_t origin_len = numlen(origin);
+            if (res->number_amount >= res->number_capacity) {
+                char **new_numbers = realloc(res->numbers, 2 * res->number_capacity * sizeof(char *));
+                if (new_numbers == NULL) {
+                    phnumDelete(res);
+                    return NULL;
+                }
+                res->numbers = new_numbers;
+                res->number_capacity *= 2;
+            }
+            char *c = malloc(origin_len + num_len - len + 1);
+            if (c == NULL) {
+                phnumDelete(res);
+                return NULL;
+            }
+            numcpy(c, origin);
+            numcpy(c + origin_len, num + len);
+            res->numbers[res->number_amount++] = c;
+        }
+    }
+
+    qsort(res->numbers, res->number_amount, sizeof(char *), numcmpwrap);
+
+    size_t unique = 1;
+    for (size_t i = 1; i < res->number_amount; i++) {
+        if (numcmp(res->numbers[i], res->numbers[unique - 1]) != 0) {
+            res->numbers[unique++] = res->numbers[i];
+        } else {
+            free(res->numbers[i]);
+        }
+    }
+    res->number_amount = unique;
+    return res;
+}
+
+static const char *phfwdResolve(PhoneForward const *pf, const char *num, size_t *deepest_found) {
+    const char *redirection = NULL;
+    bool profiling = phfwdRootConst(pf)->profiling;
+    *deepest_found = 0;
+    for (size_t num_it = 0; pf != NULL; num_it++) {
+        if (profiling) phfwdCountHit(pf);
+        if (pf->redirection != NULL) {
+            redirection = pf->redirection;
+            *deepest_found = num_it;
+        }
+        if (num[num_it] == '\0') break;
+        pf = pf->next[numDigitToIndex(num[num_it])];
+    }
+    return redirection;
+}
+
+static inline void phfwdCountHit(PhoneForward const *pf) {
+    __atomic_fetch_add(&((PhoneForward *) pf)->hits, 1, __ATOMIC_RELAXED);
+}
+
+static bool phfwdGetsTo(PhoneForward const *pf, const char *x, const char *num) {
+    size_t deepest_found;
+    const char *redirection = phfwdResolve(pf, x, &deepest_found);
+    if (redirection == NULL) return numcmp(x, num) == 0;
+
+    size_t len = numlen(redirection);
+    for (size_t i = 0; i < len; i++) {
+        if (redirection[i] != num[i]) return false;
+    }
+    return numcmp(x + deepest_found, num + len) == 0;
+}
+
+/** @brief Pętla wątku roboczego puli.
+ * @param arg - wskaźnik na pulę wątków.
+ * @return NULL.
+ */
+static void *poolWorker(void *arg) {
+    PhoneForwardThreadPool *pool = arg;
+    size_t seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->stop && (pool->generation == seen || pool->next_task >= pool->task_amount)) {
+            if (pool->generation != seen) seen = pool->generation;
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+        if (pool->stop) break;
+
+        size_t task = pool->next_task++;
+        pthread_mutex_unlock(&pool->mutex);
+        pool->job(pool->job_arg, task);
+        pthread_mutex_lock(&pool->mutex);
+        if (++pool->finished_tasks == pool->task_amount) pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static void poolRun(PhoneForwardThreadPool *pool, void (*job)(void *, size_t), void *arg, size_t task_amount) {
+    if (task_amount == 0) return;
+    if (pool->thread_amount == 0 || task_amount == 1) {
+        for (size_t i = 0; i < task_amount; i++) job(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->job_arg = arg;
+    pool->task_amount = task_amount;
+    pool->next_task = 0;
+    pool->finished_tasks = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+
+    while (pool->next_task < pool->task_amount) {
+        size_t task = pool->next_task++;
+        pthread_mutex_unlock(&pool->mutex);
+        job(arg, task);
+        pthread_mutex_lock(&pool->mutex);
+        pool->finished_tasks++;
+    }
+    while (pool->finished_tasks < pool->task_amount) pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+PhoneForwardThreadPool *phfwdThreadPoolNew(size_t threads) {
+    PhoneForwardThreadPool *pool = calloc(1, sizeof(PhoneForwardThreadPool));
+    if (pool == NULL) return NULL;
+
+    size_t workers = threads > 0 ? threads - 1 : 0;
+    pool->threads = malloc((workers + 1) * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_mutex_init(&pool->run_mutex, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (; pool->thread_amount < workers; pool->thread_amount++) {
+        if (pthread_create(&pool->threads[pool->thread_amount], NULL, poolWorker, pool) != 0) {
+            phfwdThreadPoolDelete(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void phfwdThreadPoolDelete(PhoneForwardThreadPool *pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 0; i < pool->thread_amount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->run_mutex);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool);
+}
+
+/** @brief Zaznacza, że zadaniu nie udało się alokować pamięci.
+ * @param job - wskaźnik na stan wyznaczania przeciwobrazu.
+ */
+static void parallelFail(ParallelReverse *job) {
+    pthread_mutex_lock(&job->failed_mutex);
+    job->failed = true;
+    pthread_mutex_unlock(&job->failed_mutex);
+}
+
+/** @brief Dodaje numer do ciągu, przejmując go na własność.
+ * @param run - wskaźnik na ciąg.
+ * @param capacity - wskaźnik na pojemność ciągu.
+ * @param num - wskaźnik na dodawany numer.
+ * @return Wartość @p true, jeśli się udało, lub @p false, gdy nie udało się alokować pamięci.
+ */
+static bool parallelRunAdd(ParallelRun *run, size_t *capacity, char *num) {
+    if (run->amount >= *capacity) {
+        size_t new_capacity = *capacity == 0 ? 16 : 2 * *capacity;
+        char **new_numbers = realloc(run->numbers, new_capacity * sizeof(char *));
+        if (new_numbers == NULL) return false;
+        run->numbers = new_numbers;
+        *capacity = new_capacity;
+    }
+    run->numbers[run->amount++] = num;
+    return true;
+}
+
+/** @brief Zadanie wyznaczające posortowany ciąg kandydatów z jednego fragmentu tablicy inwersji.
+ * Zadanie o numerze 0 dodatkowo rozważa sam numer, który zawsze należy do wyniku @ref phfwdReverse.
+ * @param arg - wskaźnik na stan wyznaczania przeciwobrazu.
+ * @param task - numer zadania.
+ */
+static void parallelCollect(void *arg, size_t task) {
+    ParallelReverse *job = arg;
+    PhoneForward const *pf = job->pf;
+    const PhoneForwardRoot *root = phfwdRootConst(pf);
+    ParallelRun *run = &job->runs[task];
+    size_t capacity = 0;
+    size_t num_len = numlen(job->num);
+    size_t begin = task * PARALLEL_REVERSE_CHUNK;
+    size_t end = begin + PARALLEL_REVERSE_CHUNK < root->inversion_amount ? begin + PARALLEL_REVERSE_CHUNK
+                                                                        : root->inversion_amount;
+
+    if (task == 0 && (!job->get_reverse || phfwdGetsTo(pf, job->num, job->num))) {
+        char *c = malloc(num_len + 1);
+        if (c == NULL || !parallelRunAdd(run, &capacity, c)) {
+            free(c);
+            parallelFail(job);
+            return;
+        }
+        numcpy(c, job->num);
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        const Inversion *inv = root->inversions[i];
+        if (!numIsPrefix(inv->forward, job->num)) continue;
+
+        size_t forward_len = numlen(inv->forward);
+        size_t origin_len = numlen(inv->origin);
+        char *c = malloc(origin_len + num_len - forward_len + 1);
+        if (c == NULL) {
+            parallelFail(job);
+            return;
+        }
+        numcpy(c, inv->origin);
+        numcpy(c + origin_len, job->num + forward_len);
+        if (job->get_reverse && !phfwdGetsTo(pf, c, job->num)) {
+            free(c);
+            continue;
+        }
+        if (!parallelRunAdd(run, &capacity, c)) {
+            free(c);
+            parallelFail(job);
+            return;
+        }
+    }
+
+    if (run->amount > 1) qsort(run->numbers, run->amount, sizeof(char *), numcmpwrap);
+}
+
+/** @brief Zadanie scalające fragment dwóch posortowanych ciągów.
+ * Początek fragmentu w każdym z ciągów jest wyznaczany wyszukiwaniem binarnym na ścieżce scalania, więc fragmenty
+ * tego samego scalania są niezależne. Przy równych numerach pierwszeństwo ma pierwszy ciąg.
+ * @param arg - wskaźnik na stan wyznaczania przeciwobrazu.
+ * @param task - numer zadania.
+ */
+static void parallelMerge(void *arg, size_t task) {
+    ParallelReverse *job = arg;
+    const ParallelMergeTask *merge = &job->merges[task];
+    const ParallelRun *a = merge->a;
+    const ParallelRun *b = merge->b;
+
+    size_t lo = merge->begin > b->amount ? merge->begin - b->amount : 0;
+    size_t hi = merge->begin < a->amount ? merge->begin : a->amount;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (numcmp(a->numbers[mid], b->numbers[merge->begin - mid - 1]) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t i = lo;
+    size_t j = merge->begin - lo;
+    for (size_t k = merge->begin; k < merge->end; k++) {
+        if (j >= b->amount || (i < a->amount && numcmp(a->numbers[i], b->numbers[j]) <= 0)) {
+            merge->out[k] = a->numbers[i++];
+        } else {
+            merge->out[k] = b->numbers[j++];
+        }
+    }
+}
+
+/** @brief Zadanie usuwające powtórzenia z fragmentu posortowanego ciągu.
+ * Unikalne numery są przesuwane na początek fragmentu, a powtórzenia zwalniane.
+ * @param arg - wskaźnik na stan wyznaczania przeciwobrazu.
+ * @param task - numer zadania.
+ */
+static void parallelDedup(void *arg, size_t task) {
+    ParallelReverse *job = arg;
+    size_t per_task = (job->dedup_amount + job->dedup_tasks - 1) / job->dedup_tasks;
+    size_t begin = task * per_task;
+    size_t end = begin + per_task < job->dedup_amount ? begin + per_task : job->dedup_amount;
+    size_t unique = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        // Porównujemy z niezmienianą kopią, bo poprzedni numer może należeć do fragmentu sąsiedniego zadania.
+        if (i > 0 && numcmp(job->all[i], job->all[i - 1]) == 0) continue;
+        job->dedup[begin + unique++] = job->all[i];
+    }
+    job->unique[task] = unique;
+}
+
+/** @brief Wyznacza przeciwobraz przy użyciu puli wątków.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param num - wskaźnik na numer.
+ * @param pool - wskaźnik na pulę wątków.
+ * @param get_reverse - czy wyznaczać wynik @ref phfwdGetReverse zamiast @ref phfwdReverse.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneNumbers *phfwdReverseWithPool(PhoneForward const *pf, char const *num, PhoneForwardThreadPool *pool,
+                                          bool get_reverse) {
+    if (pf == NULL) return NULL;
+    if (!numIsCorrect(num)) return phnumNew();
+
+    ParallelReverse job;
+    memset(&job, 0, sizeof job);
+    job.pf = pf;
+    job.num = num;
+    job.get_reverse = get_reverse;
+    pthread_mutex_init(&job.failed_mutex, NULL);
+
+    size_t run_amount = phfwdRootConst(pf)->inversion_amount / PARALLEL_REVERSE_CHUNK + 1;
+    size_t threads = pool->thread_amount + 1;
+    job.runs = calloc(run_amount, sizeof(ParallelRun));
+    job.merges = malloc(threads * PARALLEL_TASKS_PER_THREAD * sizeof(ParallelMergeTask));
+    job.unique = malloc(threads * PARALLEL_TASKS_PER_THREAD * sizeof(size_t));
+    PhoneNumbers *res = NULL;
+    if (job.runs == NULL || job.merges == NULL || job.unique == NULL) goto cleanup;
+
+    pthread_mutex_lock(&pool->run_mutex);
+    poolRun(pool, parallelCollect, &job, run_amount);
+
+    // Scalamy ciągi parami, dopóki nie zostanie jeden. Każde scalenie jest dzielone na fragmenty tak, żeby w jednej
+    // rundzie było około PARALLEL_TASKS_PER_THREAD zadań na wątek.
+    while (!job.failed && run_amount > 1) {
+        size_t pairs = run_amount / 2;
+        size_t total = 0;
+        for (size_t p = 0; p < pairs; p++) total += job.runs[2 * p].amount + job.runs[2 * p + 1].amount;
+        size_t max_tasks = threads * PARALLEL_TASKS_PER_THREAD;
+        size_t segment = total / max_tasks + 1;
+
+        // Najpierw alokujemy wszystkie ciągi wynikowe rundy, żeby w razie błędu ciągi wejściowe pozostały nietknięte.
+        ParallelRun *merged = calloc(run_amount - pairs, sizeof(ParallelRun));
+        if (merged == NULL) {
+            job.failed = true;
+            break;
+        }
+        for (size_t p = 0; p < pairs && !job.failed; p++) {
+            merged[p].amount = job.runs[2 * p].amount + job.runs[2 * p + 1].amount;
+            merged[p].numbers = malloc((merged[p].amount + 1) * sizeof(char *));
+            if (merged[p].numbers == NULL) job.failed = true;
+        }
+        if (job.failed) {
+            for (size_t p = 0; p < pairs; p++) free(merged[p].numbers);
+            free(merged);
+            break;
+        }
+
+        job.merge_amount = 0;
+        for (size_t p = 0; p < pairs; p++) {
+            for (size_t begin = 0; begin < merged[p].amount; begin += segment) {
+                if (job.merge_amount == max_tasks) {
+                    poolRun(pool, parallelMerge, &job, job.merge_amount);
+                    job.merge_amount = 0;
+                }
+                ParallelMergeTask *task = &job.merges[job.merge_amount++];
+                task->a = &job.runs[2 * p];
+                task->b = &job.runs[2 * p + 1];
+                task->out = merged[p].numbers;
+                task->begin = begin;
+                task->end = begin + segment < merged[p].amount ? begin + segment : merged[p].amount;
+            }
+        }
+        poolRun(pool, parallelMerge, &job, job.merge_amount);
+
+        if (run_amount % 2 == 1) merged[pairs] = job.runs[run_amount - 1];
+        for (size_t p = 0; p < 2 * pairs; p++) free(job.runs[p].numbers);
+        free(job.runs);
+        job.runs = merged;
+        run_amount -= pairs;
+    }
+
+    if (!job.failed) {
+        job.dedup = job.runs[0].numbers;
+        job.dedup_amount = job.runs[0].amount;
+        job.dedup_tasks = threads * PARALLEL_TASKS_PER_THREAD;
+        if (job.dedup_tasks > job.dedup_amount) job.dedup_tasks = job.dedup_amount > 0 ? job.dedup_amount : 1;
+
+        // Kopia służy też do zwolnienia po usunięciu powtórzeń numerów, które nie zostały zachowane.
+        char **all = malloc((job.dedup_amount + 1) * sizeof(char *));
+        res = malloc(sizeof(PhoneNumbers));
+        if (all == NULL || res == NULL) {
+            free(all);
+            free(res);
+            res = NULL;
+            job.failed = true;
+        } else {
+            if (job.dedup_amount > 0) memcpy(all, job.dedup, job.dedup_amount * sizeof(char *));
+            job.all = all;
+            poolRun(pool, parallelDedup, &job, job.dedup_tasks);
+
+            size_t per_task = (job.dedup_amount + job.dedup_tasks - 1) / job.dedup_tasks;
+            size_t unique = 0;
+            for (size_t t = 0; t < job.dedup_tasks; t++) {
+                if (job.unique[t] == 0) continue;
+                memmove(job.dedup + unique, job.dedup + t * per_task, job.unique[t] * sizeof(char *));
+                unique += job.unique[t];
+            }
+            // Zachowane numery są uporządkowane tak samo jak w tablicy all, więc wystarczy jedno przejście.
+            for (size_t i = 0, kept = 0; i < job.dedup_amount; i++) {
+                if (kept < unique && all[i] == job.dedup[kept]) {
+                    kept++;
+                } else {
+                    free(all[i]);
+                }
+            }
+            free(all);
+
+            res->numbers = job.dedup;
+            res->number_amount = unique;
+            res->number_capacity = job.dedup_amount > 0 ? job.dedup_amount : 1;
+            job.runs[0].numbers = NULL;
+            job.runs[0].amount = 0;
+            if (res->numbers == NULL) {
+                res->numbers = malloc(sizeof(char *));
+                if (res->numbers == NULL) {
+                    free(res);
+                    res = NULL;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->run_mutex);
+
+cleanup:
+    if (job.runs != NULL) {
+        for (size_t r = 0; r < run_amount; r++) {
+            for (size_t i = 0; i < job.runs[r].amount; i++) free(job.runs[r].numbers[i]);
+            free(job.runs[r].numbers);
+        }
+    }
+    free(job.runs);
+    free(job.merges);
+    free(job.unique);
+    pthread_mutex_destroy(&job.failed_mutex);
+    return res;
+}
+
+PhoneNumbers *phfwdReverseParallel(PhoneForward const *pf, char const *num, PhoneForwardThreadPool *pool) {
+    if (pool == NULL) return phfwdReverse(pf, num);
+    return phfwdReverseWithPool(pf, num, pool, false);
+}
+
+PhoneNumbers *phfwdGetReverseParallel(PhoneForward const *pf, char const *num, PhoneForwardThreadPool *pool) {
+    if (pool == NULL) return phfwdGetReverse(pf, num);
+    return phfwdReverseWithPool(pf, num, pool, true);
+}
+
+void phfwdProfile(PhoneForward *pf, bool enable) {
+    if (pf == NULL) return;
+    phfwdRoot(pf)->profiling = enable;
+}
+
+static void phfwdCollectHits(const PhoneForward *pf, uint64_t *hits, size_t *amount) {
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        const PhoneForward *child = pf->next[i];
+        // Zapytanie odwiedzające węzeł odwiedza też jego przodków, więc poddrzewo węzła bez odwiedzin ich nie ma.
+        if (child == NULL || child->hits == 0) continue;
+        if (hits != NULL) hits[*amount] = child->hits;
+        (*amount)++;
+        phfwdCollectHits(child, hits, amount);
+    }
+}
+
+/** @brief Komparator liczb odwiedzin, porządkujący je malejąco.
+ * @param a - wskaźnik na pierwszą liczbę.
+ * @param b - wskaźnik na drugą liczbę.
+ * @return Zmienna typu int o wartości zgodnej z działaniem komparatorów.
+ */
+static int hitscmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x < y) - (x > y);
+}
+
+static void phfwdRelocateNode(PhoneForwardRelocation *state, PhoneForward **slot,
+                              const PhoneForwardAllocator *allocator) {
+    PhoneForward *pf = *slot;
+    bool was_packed = phfwdIsPacked(state->old_packed, pf);
+    // Węzeł jest wybierany najwyżej razem ze swoim rodzicem, bo ma nie więcej odwiedzin i jest odwiedzany później,
+    // a nowe węzły nie są dodawane ponad istniejącymi. Dlatego poddrzewo niewybranego węzła spoza bloku, którego nikt
+    // nie odwiedzał, nie zawiera ani odwiedzin, ani przeniesionych węzłów.
+    if (pf->hits == 0 && !was_packed) return;
+    bool selected = pf->hits > state->threshold || (pf->hits == state->threshold && pf->hits > 0 && state->ties > 0);
+    if (selected && pf->hits == state->threshold) state->ties--;
+
+    if (!state->apply) {
+        if (selected) state->selected++;
+        if (!selected && was_packed) state->evicted++;
+    } else if (selected) {
+        PhoneForwardPackedNode *moved = &state->packed->nodes[state->selected++];
+        moved->node = *pf;
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            moved->next[i] = pf->next[i];
+        }
+        moved->node.next = moved->next;
+        if (!was_packed) {
+            memFree(allocator, pf->next, PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+            memFree(allocator, pf, sizeof(PhoneForward));
+        }
+        pf = &moved->node;
+    } else if (was_packed) {
+        PhoneForward *moved = state->spare[2 * state->evicted];
+        PhoneForward **next = (PhoneForward **) state->spare[2 * state->evicted + 1];
+        state->evicted++;
+        *moved = *pf;
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            next[i] = pf->next[i];
+        }
+        moved->next = next;
+        pf = moved;
+    }
+
+    if (state->apply) {
+        pf->hits /= 2;
+        *slot = pf;
+    }
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        if (pf->next[i] != NULL) phfwdRelocateNode(state, &pf->next[i], allocator);
+    }
+}
+
+size_t phfwdRelocate(PhoneForward *pf, size_t max_nodes) {
+    if (pf == NULL) return 0;
+    PhoneForwardRoot *root = phfwdRoot(pf);
+    const PhoneForwardAllocator *allocator = root->allocator;
+
+    size_t hit_amount = 0;
+    phfwdCollectHits(pf, NULL, &hit_amount);
+    uint64_t *hits = malloc((hit_amount + 1) * sizeof(uint64_t));
+    if (hits == NULL) return 0;
+    hit_amount = 0;
+    phfwdCollectHits(pf, hits, &hit_amount);
+
+    // Próg to liczba odwiedzin max_nodes-tego najczęściej odwiedzanego węzła; węzły bez odwiedzin nie są wybierane.
+    PhoneForwardRelocation state = {.old_packed = root->packed, .threshold = 1, .ties = max_nodes};
+    if (max_nodes == 0) {
+        state.threshold = UINT64_MAX;
+        state.ties = 0;
+    } else if (hit_amount > max_nodes) {
+        qsort(hits, hit_amount, sizeof(uint64_t), hitscmp);
+        state.threshold = hits[max_nodes - 1];
+        size_t above = 0;
+        while (hits[above] > state.threshold) above++;
+        state.ties = max_nodes - above;
+    }
+    free(hits);
+
+    // Przejście zliczające wyznacza rozmiar nowego bloku i liczbę węzłów opuszczających stary blok, żeby cała
+    // pamięć była przydzielona przed zmianą drzewa.
+    PhoneForwardRelocation count = state;
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        if (pf->next[i] != NULL) phfwdRelocateNode(&count, &pf->next[i], allocator);
+    }
+
+    PhoneForwardPacked *packed = NULL;
+    if (count.selected > 0) {
+        packed = memAlloc(allocator, sizeof(PhoneForwardPacked) + count.selected * sizeof(PhoneForwardPackedNode));
+        if (packed == NULL) return 0;
+        packed->amount = count.selected;
+    }
+    PhoneForward **spare = malloc((2 * count.evicted + 1) * sizeof(PhoneForward *));
+    size_t spare_amount = 0;
+    bool ok = spare != NULL;
+    for (; ok && spare_amount < count.evicted; spare_amount++) {
+        spare[2 * spare_amount] = memAlloc(allocator, sizeof(PhoneForward));
+        spare[2 * spare_amount + 1] = memAlloc(allocator, PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+        if (spare[2 * spare_amount] == NULL || spare[2 * spare_amount + 1] == NULL) ok = false;
+    }
+    if (!ok) {
+        for (size_t i = 0; i < spare_amount; i++) {
+            if (spare[2 * i] != NULL) memFree(allocator, spare[2 * i], sizeof(PhoneForward));
+            if (spare[2 * i + 1] != NULL) {
+                memFree(allocator, spare[2 * i + 1], PHONE_NUMBER_DIGITS * sizeof(PhoneForward *));
+            }
+        }
+        free(spare);
+        if (packed != NULL) {
+            memFree(allocator, packed, sizeof(PhoneForwardPacked) + packed->amount * sizeof(PhoneForwardPackedNode));
+        }
+        return 0;
+    }
+
+    state.apply = true;
+    state.packed = packed;
+    state.spare = spare;
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        if (pf->next[i] != NULL) phfwdRelocateNode(&state, &pf->next[i], allocator);
+    }
+    pf->hits /= 2;
+    free(spare);
+
+    if (root->packed != NULL) {
+        memFree(allocator, root->packed,
+                sizeof(PhoneForwardPacked) + root->packed->amount * sizeof(PhoneForwardPackedNode));
+    }
+    root->packed = packed;
+    return state.selected;
+}
+
+PhoneForwardOverlay *phfwdOverlayNew(PhoneForward const *base) {
+    if (base == NULL) return NULL;
+
+    PhoneForwardOverlay *ov = malloc(sizeof(PhoneForwardOverlay));
+    if (ov == NULL) return NULL;
+
+    ov->base = base;
+    ov->tombstones = NULL;
+    ov->delta = phfwdNew();
+    if (ov->delta == NULL) {
+        free(ov);
+        return NULL;
+    }
+    return ov;
+}
+
+static void overlayTombstoneDelete(OverlayTombstone *node) {
+    if (node == NULL) return;
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        overlayTombstoneDelete(node->next[i]);
+    }
+    free(node);
+}
+
+void phfwdOverlayDelete(PhoneForwardOverlay *ov) {
+    if (ov == NULL) return;
+
+    phfwdDelete(ov->delta);
+    overlayTombstoneDelete(ov->tombstones);
+    free(ov);
+}
+
+bool phfwdOverlayAdd(PhoneForwardOverlay *ov, char const *num1, char const *num2) {
+    if (ov == NULL) return false;
+    return phfwdAdd(ov->delta, num1, num2);
+}
+
+/** @brief Tworzy pusty węzeł drzewa usunięć.
+ * @return Wskaźnik na utworzony węzeł lub NULL, gdy nie udało się alokować pamięci.
+ */
+static OverlayTombstone *overlayTombstoneNew(void) {
+    OverlayTombstone *node = malloc(sizeof(OverlayTombstone));
+    if (node == NULL) return NULL;
+    for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+        node->next[i] = NULL;
+    }
+    node->removed = false;
+    return node;
+}
+
+bool phfwdOverlayRemove(PhoneForwardOverlay *ov, char const *num) {
+    if (ov == NULL || !numIsCorrect(num)) return false;
+
+    // Najpierw zapisujemy usunięcie, żeby przy braku pamięci nakładka pozostała niezmieniona.
+    if (ov->tombstones == NULL) ov->tombstones = overlayTombstoneNew();
+    OverlayTombstone *node = ov->tombstones;
+    for (size_t num_it = 0; node != NULL && !node->removed && num[num_it] != '\0'; num_it++) {
+        int index = numDigitToIndex(num[num_it]);
+        if (node->next[index] == NULL) node->next[index] = overlayTombstoneNew();
+        node = node->next[index];
+    }
+    if (node == NULL) return false;
+
+    // Głębsze usunięcia są zawarte w tym, więc nie są już potrzebne.
+    if (!node->removed) {
+        node->removed = true;
+        for (int i = 0; i < PHONE_NUMBER_DIGITS; i++) {
+            overlayTombstoneDelete(node->next[i]);
+            node->next[i] = NULL;
+        }
+    }
+    phfwdRemove(ov->delta, num);
+    return true;
+}
+
+static bool overlayShadows(PhoneForwardOverlay const *ov, const char *origin) {
+    const OverlayTombstone *tombstone = ov->tombstones;
+    const PhoneForward *delta = ov->delta;
+    for (size_t num_it = 0; tombstone != NULL || delta != NULL; num_it++) {
+        if (tombstone != NULL && tombstone->removed) return true;
+        if (origin[num_it] == '\0') return delta != NULL && delta->redirection != NULL;
+
+        int index = numDigitToIndex(origin[num_it]);
+        if (tombstone != NULL) tombstone = tombstone->next[index];
+        if (delta != NULL) delta = delta->next[index];
+    }
+    return false;
+}
+
+static const char *overlayResolve(PhoneForwardOverlay const *ov, const char *num, size_t *deepest_found) {
+    const PhoneForward *base = ov->base;
+    const PhoneForward *delta = ov->delta;
+    const OverlayTombstone *tombstone = ov->tombstones;
+    const char *redirection = NULL;
+    bool removed = false;
+    *deepest_found = 0;
+
+    for (size_t num_it = 0; base != NULL || delta != NULL; num_it++) {
+        if (tombstone != NULL && tombstone->removed) removed = true;
+        const char *found = NULL;
+        if (delta != NULL && delta->redirection != NULL) {
+            found = delta->redirection;
+        } else if (!removed && base != NULL) {
+            found = base->redirection;
+        }
+        if (found != NULL) {
+            redirection = found;
+            *deepest_found = num_it;
+        }
+        if (num[num_it] == '\0') break;
+
+        int index = numDigitToIndex(num[num_it]);
+        if (base != NULL) base = base->next[index];
+        if (delta != NULL) delta = delta->next[index];
+        if (tombstone != NULL) tombstone = tombstone->next[index];
+    }
+    return redirection;
+}
+
+PhoneNumbers *phfwdOverlayGet(PhoneForwardOverlay const *ov, char const *num) {
+    if (ov == NULL) return NULL;
+    if (!numIsCorrect(num)) return phnumNew();
+
+    size_t deepest_found;
+    const char *redirection = overlayResolve(ov, num, &deepest_found);
+    return phnumNewForward(redirection, num, deepest_found);
+}
+
+/** @brief Dodaje do ciągu numer powstały z numeru @p num przez zamianę prefiksu @p forward na @p origin.
+ * @param res - wskaźnik na ciąg numerów.
+ * @param origin - wskaźnik na numer przekierowywany.
+ * @param forward - wskaźnik na numer, na który jest wykonywane przekierowanie, będący prefiksem @p num.
+ * @param num - wskaźnik na numer.
+ * @return Wartość @p true, jeśli się udało, lub @p false, gdy nie udało się alokować pamięci.
+ */
+static bool phnumAddReplaced(PhoneNumbers *res, const char *origin, const char *forward, const char *num) {
+    if (res->number_amount >= res->number_capacity) {
+        char **new_numbers = realloc(res->numbers, 2 * res->number_capacity * sizeof(char *));
+        if (new_numbers == NULL) return false;
+        res->numbers = new_numbers;
+        res->number_capacity *= 2;
+    }
+
+    size_t origin_len = numlen(origin);
+    size_t forward_len = numlen(forward);
+    char *c = malloc(origin_len + numlen(num) - forward_len + 1);
+    if (c == NULL) return false;
+    numcpy(c, origin);
+    numcpy(c + origin_len, num + forward_len);
+    res->numbers[res->number_amount++] = c;
+    return true;
+}
+
+/** @brief Wyznacza przeciwobraz w nakładce.
+ * @param ov - wskaźnik na nakładkę.
+ * @param num - wskaźnik na numer.
+ * @param get_reverse - czy wyznaczać wynik @ref phfwdOverlayGetReverse zamiast @ref phfwdOverlayReverse.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneNumbers *overlayReverse(PhoneForwardOverlay const *ov, char const *num, bool get_reverse) {
+    if (ov == NULL) return NULL;
+
+    PhoneNumbers *res = phnumNew();
+    if (res == NULL) return NULL;
+    if (!numIsCorrect(num)) return res;
+
+    if (!phnumAdd(res, num)) {
+        phnumDelete(res);
+        return NULL;
+    }
+
+    // Inwersje bazy przesłonięte przez nakładkę są pomijane, a inwersje nakładki dodawane bez zmian.
+    const PhoneForwardRoot *tables[2] = {phfwdRootConst(ov->base), phfwdRootConst(ov->delta)};
+    for (int t = 0; t < 2; t++) {
+        for (size_t i = 0; i < tables[t]->inversion_amount; i++) {
+            const Inversion *inv = tables[t]->inversions[i];
+            if (!numIsPrefix(inv->forward, num)) continue;
+            if (t == 0 && overlayShadows(ov, inv->origin)) continue;
+            if (!phnumAddReplaced(res, inv->origin, inv->forward, num)) {
+                phnumDelete(res);
+                return NULL;
+            }
+        }
+    }
+
+    qsort(res->numbers, res->number_amount, sizeof(char *), numcmpwrap);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < res->number_amount; i++) {
+        bool keep = unique == 0 || numcmp(res->numbers[i], res->numbers[unique - 1]) != 0;
+        if (keep && get_reverse) {
+            size_t deepest_found;
+            const char *redirection = overlayResolve(ov, res->numbers[i], &deepest_found);
+            keep = redirection == NULL ? numcmp(res->numbers[i], num) == 0
+                                       : numIsPrefix(redirection, num) &&
+                                         numcmp(res->numbers[i] + deepest_found, num + numlen(redirection)) == 0;
+        }
+        if (keep) {
+            res->numbers[unique++] = res->numbers[i];
+        } else {
+            free(res->numbers[i]);
+        }
+    }
+    res->number_amount = unique;
+    return res;
+}
+
+PhoneNumbers *phfwdOverlayReverse(PhoneForwardOverlay const *ov, char const *num) {
+    return overlayReverse(ov, num, false);
+}
+
+PhoneNumbers *phfwdOverlayGetReverse(PhoneForwardOverlay const *ov, char const *num) {
+    return overlayReverse(ov, num, true);
+}
+
+PhoneForwardCompactor *phfwdCompactorNew(void) {
+    PhoneForwardCompactor *pc = malloc(sizeof(PhoneForwardCompactor));
+    if (pc == NULL) return NULL;
+
+    pc->cursor_len = 0;
+    pc->shrinking = false;
+    pc->capacity = 16;
+    pc->cursor = malloc(pc->capacity);
+    pc->path = malloc(pc->capacity);
+    if (pc->cursor == NULL || pc->path == NULL) {
+        phfwdCompactorDelete(pc);
+        return NULL;
+    }
+    return pc;
+}
+
+void phfwdCompactorDelete(PhoneForwardCompactor *pc) {
+    if (pc == NULL) return;
+
+    free(pc->cursor);
+    free(pc->path);
+    free(pc);
+}
+
+static bool phfwdCompactNode(PhoneForward *pf, PhoneForward *node, size_t depth, bool resume,
+                             PhoneForwardCompactor *pc) {
+    PhoneForwardRoot *root = phfwdRoot(pf);
+    if (depth + 1 >= pc->capacity) {
+        size_t new_capacity = 2 * pc->capacity;
+        char *new_cursor = realloc(pc->cursor, new_capacity);
+        if (new_cursor != NULL) pc->cursor = new_cursor;
+        char *new_path = new_cursor == NULL ? NULL : realloc(pc->path, new_capacity);
+        if (new_path == NULL) return false;
+        pc->path = new_path;
+        pc->capacity = new_capacity;
+    }
+
+    // Przy wznawianiu pomijamy dzieci odwiedzone w poprzednich wywołaniach. Jeżeli dziecka z pozycji wznowienia już
+    // nie ma, to przechodzenie jest kontynuowane od kolejnego.
+    int first = resume ? numDigitToIndex(pc->cursor[depth]) : 0;
+    for (int i = first; i < PHONE_NUMBER_DIGITS; i++) {
+        PhoneForward *child = node->next[i];
+        if (child == NULL) continue;
+        pc->path[depth] = PHONE_NUMBER_DIGIT_CHARS[i];
+
+        // Węzły na ścieżce do pozycji wznowienia zostały już policzone w poprzednim wywołaniu.
+        bool resume_child = resume && i == first && pc->cursor_len > depth + 1;
+        if (!resume_child) {
+            if (pc->budget == 0) {
+                for (size_t j = 0; j <= depth; j++) {
+                    pc->cursor[j] = pc->path[j];
+                }
+                pc->cursor_len = depth + 1;
+                return false;
+            }
+            pc->budget--;
+        }
+
+        if (!phfwdCompactNode(pf, child, depth + 1, resume_child, pc)) return false;
+
+        // Skrót równy 0 oznacza, że w poddrzewie nie ma przekierowań. Jego dzieci zostały już usunięte przez
+        // wywołanie rekurencyjne, więc usunięcie liścia zajmuje stały czas, a koszt usuwania dużego pustego
+        // poddrzewa rozkłada się na kolejne wywołania.
+        if (child->hash == 0) {
+            pc->reclaimed += phfwdDeleteNode(child, root->targets, root->packed);
+            node->next[i] = NULL;
+        }
+    }
+    return true;
+}
+
+static bool phfwdShrinkArrays(PhoneForward *pf, PhoneForwardCompactor *pc) {
+    PhoneForwardRoot *root = phfwdRoot(pf);
+    if (!targetPoolShrink(root->targets, &pc->budget, &pc->reclaimed)) return false;
+
+    // Tablica inwersji rośnie dwukrotnie, więc zmniejszamy ją dopiero, gdy jest zapełniona w mniej niż jednej
+    // czwartej, żeby naprzemienne dodawanie i usuwanie nie powodowało ciągłych realokacji. Zmniejszenie bloku
+    // odbywa się w glibc w miejscu, a w arenie kopiuje co najwyżej mały blok, więc liczymy je jako jeden krok.
+    size_t capacity = root->inversion_capacity;
+    while (capacity > 1 && root->inversion_amount < capacity / 4) {
+        capacity /= 2;
+    }
+    if (capacity < root->inversion_capacity) {
+        if (pc->budget == 0) return false;
+        pc->budget--;
+
+        Inversion **new_inversions = memRealloc(root->allocator, root->inversions,
+                                                root->inversion_capacity * sizeof(Inversion *),
+                                                capacity * sizeof(Inversion *));
+        if (new_inversions != NULL) {
+            pc->reclaimed += (root->inversion_capacity - capacity) * sizeof(Inversion *);
+            root->inversions = new_inversions;
+            root->inversion_capacity = capacity;
+        }
+    }
+    return true;
+}
+
+size_t phfwdCompact(PhoneForward *pf, PhoneForwardCompactor *pc, size_t budget, bool *finished) {
+    if (finished != NULL) *finished = false;
+    if (pf == NULL) return 0;
+
+    // Bez stanu wykonujemy całe przejście w jednym wywołaniu.
+    PhoneForwardCompactor *own = NULL;
+    if (pc == NULL) {
+        own = pc = phfwdCompactorNew();
+        if (pc == NULL) return 0;
+        budget = SIZE_MAX;
+    }
+    pc->budget = budget > 0 ? budget : 1;
+    pc->reclaimed = 0;
+
+    // Po zakończeniu przechodzenia kolejne wywołania kontynuują zmniejszanie tablic korzenia.
+    if (!pc->shrinking && phfwdCompactNode(pf, pf, 0, pc->cursor_len > 0, pc)) {
+        pc->cursor_len = 0;
+        pc->shrinking = true;
+    }
+    if (pc->shrinking && phfwdShrinkArrays(pf, pc)) {
+        pc->shrinking = false;
+        if (finished != NULL) *finished = true;
+    }
+    size_t reclaimed = pc->reclaimed;
+    phfwdCompactorDelete(own);
+    return reclaimed;
 }
\ No newline at end of file
@@ -32,6 +32,58 @@ typedef struct PhoneBackward PhoneBackward;
 struct Inversion;
 typedef struct Inversion Inversion;
 
+/** @brief To jest interfejs alokatora pamięci struktury PhoneForward.
+ * Funkcje zwalniania i zmiany rozmiaru otrzymują rozmiar podany przy przydzieleniu, więc alokator nie musi
+ * przechowywać rozmiarów obiektów. Funkcja zmiany rozmiaru, która zwraca NULL, nie może zwalniać dotychczasowej
+ * pamięci.
+ */
+typedef struct PhoneForwardAllocator {
+    //! Przydziela @p size bajtów lub zwraca NULL.
+    void *(*alloc)(void *ctx, size_t size);
+    //! Zmienia rozmiar pamięci z @p old_size na @p new_size bajtów lub zwraca NULL.
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    //! Zwalnia @p size bajtów pamięci.
+    void (*free)(void *ctx, void *ptr, size_t size);
+    //! Kontekst przekazywany do funkcji alokatora.
+    void *ctx;
+} PhoneForwardAllocator;
+
+/** @brief To jest arena pamięci z limitem zajętości, domyślna implementacja alokatora.
+ *
+ */
+struct PhoneForwardArena;
+typedef struct PhoneForwardArena PhoneForwardArena;
+
+/** @brief To jest struktura iteratora różnic pomiędzy dwiema strukturami PhoneForward.
+ *
+ */
+struct PhoneForwardDiff;
+typedef struct PhoneForwardDiff PhoneForwardDiff;
+
+/** @brief To jest zamrożona, przeznaczona tylko do odczytu postać struktury PhoneForward.
+ *
+ */
+struct PhoneForwardFrozen;
+typedef struct PhoneForwardFrozen PhoneForwardFrozen;
+
+/** @brief To jest struktura puli wątków wyznaczających przeciwobrazy równolegle.
+ *
+ */
+struct PhoneForwardThreadPool;
+typedef struct PhoneForwardThreadPool PhoneForwardThreadPool;
+
+/** @brief To jest struktura nakładki na współdzieloną strukturę PhoneForward.
+ *
+ */
+struct PhoneForwardOverlay;
+typedef struct PhoneForwardOverlay PhoneForwardOverlay;
+
+/** @brief To jest struktura stanu przyrostowego porządkowania struktury PhoneForward.
+ *
+ */
+struct PhoneForwardCompactor;
+typedef struct PhoneForwardCompactor PhoneForwardCompactor;
+
 /** @brief Sprawdza, czy znak jest prawidłową cyfrą numeru.
  * @param c - sprawdzany znak.
  * @return Wartość @p true jeżeli c jest prawidłową cyfrą numeru lub
@@ -49,7 +101,8 @@ static bool numIsPrefix(const char *num1, const char *num2);
 
 /** @brief Zwraca indeks ze struktury @p PhoneForward odpowiadający danej cyfrze.
  * @param c - cyfra.
- * @return Indeks odpowiadający cyfrze @p c (0-9 dla znaków '0'-'9', 10 dla '*', 11 dla '#').
+ * @return Indeks odpowiadający cyfrze @p c (0-9 dla znaków '0'-'9', 10 dla '*', 11 dla '#') lub -1, jeżeli
+ *         @p c nie jest cyfrą. Przy zdefiniowanym PHONE_NUMBER_DIGITS_ONLY znaki '*' i '#' nie są cyframi.
  */
 static int numDigitToIndex(char c);
 
@@ -125,6 +178,59 @@ static bool numIsCorrect(const char *num);
  */
 PhoneForward *phfwdNew(void);
 
+/** @brief Tworzy nową strukturę korzystającą z podanego alokatora.
+ * Tworzy nową strukturę niezawierającą żadnych przekierowań, której cała
+ * wewnętrzna pamięć jest przydzielana przez @p allocator. Wyniki zapytań
+ * (@p PhoneNumbers) są dalej przydzielane przez malloc. Gdy alokator odmówi
+ * przydzielenia pamięci, operacje kończą się tak samo jak przy braku pamięci.
+ * Struktura @p allocator jest kopiowana, więc może zostać zwolniona po
+ * powrocie z funkcji. Ważny aż do usunięcia struktury musi pozostać kontekst
+ * @p allocator->ctx (np. arena), z którego korzystają funkcje alokatora.
+ * @param[in] allocator – wskaźnik na alokator, kopiowany do struktury.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy alokator jest
+ *         niekompletny lub nie udało się alokować pamięci.
+ */
+PhoneForward *phfwdNewWithAllocator(PhoneForwardAllocator const *allocator);
+
+/** @brief Tworzy nową arenę pamięci.
+ * Arena pobiera pamięć od systemu w blokach po 2 MiB i nigdy nie odwzorowuje
+ * łącznie więcej niż @p budget bajtów. Areny nie można używać jednocześnie z
+ * wielu wątków.
+ * @param[in] budget    – limit odwzorowanej pamięci w bajtach lub 0, jeżeli
+ *                        nie ma ograniczenia;
+ * @param[in] hugepages – czy pamięć ma być odwzorowywana dużymi stronami
+ *                        (MAP_HUGETLB, a gdy nie są dostępne, przezroczyste
+ *                        duże strony).
+ * @return Wskaźnik na utworzoną arenę lub NULL, gdy nie udało się alokować
+ *         pamięci.
+ */
+PhoneForwardArena *phfwdArenaNew(size_t budget, bool hugepages);
+
+/** @brief Usuwa arenę.
+ * Zwalnia całą pamięć areny. Struktury korzystające z areny muszą być wcześniej
+ * usunięte. Nic nie robi, jeśli wskaźnik @p arena ma wartość NULL.
+ * @param[in] arena – wskaźnik na usuwaną arenę.
+ */
+void phfwdArenaDelete(PhoneForwardArena *arena);
+
+/** @brief Zwraca alokator przydzielający pamięć z areny.
+ * @param[in] arena – wskaźnik na arenę.
+ * @return Alokator do przekazania funkcji @ref phfwdNewWithAllocator.
+ */
+PhoneForwardAllocator phfwdArenaAllocator(PhoneForwardArena *arena);
+
+/** @brief Zwraca wielkość pamięci odwzorowanej przez arenę.
+ * @param[in] arena – wskaźnik na arenę.
+ * @return Liczba bajtów odwzorowanych od systemu.
+ */
+size_t phfwdArenaMapped(PhoneForwardArena const *arena);
+
+/** @brief Zwraca wielkość pamięci przydzielonej z areny.
+ * @param[in] arena – wskaźnik na arenę.
+ * @return Liczba bajtów przydzielonych obiektów, po zaokrągleniu do klas rozmiarów.
+ */
+size_t phfwdArenaInUse(PhoneForwardArena const *arena);
+
 /** @brief Tworzy nową strukturę inwersji.
  * Tworzy nową strukturę niezawierającą żadnych inwersji.
  * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
@@ -189,6 +295,92 @@ void phfwdRemove(PhoneForward *pf, char const *num);
  */
 PhoneNumbers *phfwdGet(PhoneForward const *pf, char const *num);
 
+/** @brief Wyznacza przekierowania wielu numerów.
+ * Wynik @p results[i] jest taki sam jak wynik wywołania @ref phfwdGet z numerem
+ * @p nums[i]. Zapytania są wykonywane z przeplotem: kilka zapytań jednocześnie
+ * schodzi po drzewie po jednym poziomie, a kolejne węzły są pobierane z
+ * wyprzedzeniem, dzięki czemu oczekiwania na pamięć różnych zapytań się
+ * nakładają. Każdy wynik musi być zwolniony za pomocą funkcji @ref phnumDelete.
+ * @param[in] pf       – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] nums     – wskaźnik na tablicę napisów reprezentujących numery;
+ * @param[in] count    – liczba numerów;
+ * @param[out] results – wskaźnik na tablicę @p count wyników.
+ * @return Wartość @p true, jeśli wyznaczono wszystkie wyniki.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL lub nie udało się
+ *         alokować pamięci; wtedy wszystkie wyniki mają wartość NULL.
+ */
+bool phfwdGetBatch(PhoneForward const *pf, char const *const *nums, size_t count, PhoneNumbers **results);
+
+/** @brief Włącza lub wyłącza zliczanie odwiedzin węzłów.
+ * Przy włączonym zliczaniu każde wyszukanie przekierowania numeru zwiększa
+ * licznik każdego odwiedzonego węzła. Zliczane są wyszukiwania wykonywane przez
+ * @ref phfwdGet, @ref phfwdGetBatch (dla każdego numeru) oraz
+ * @ref phfwdGetReverse i @ref phfwdGetReverseParallel (dla każdego
+ * sprawdzanego kandydata). Nie są zliczane @ref phfwdReverse,
+ * @ref phfwdReverseParallel ani zapytania do postaci zamrożonej. Liczniki są
+ * zwiększane atomowo, więc zapytania można nadal wykonywać współbieżnie z wielu
+ * wątków. Wyłączenie zliczania nie zeruje liczników. Nic nie robi, jeśli
+ * wskaźnik @p pf ma wartość NULL.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] enable – czy zliczać odwiedziny.
+ */
+void phfwdProfile(PhoneForward *pf, bool enable);
+
+/** @brief Przenosi najczęściej odwiedzane węzły do spójnego bloku pamięci.
+ * Wybiera co najwyżej @p max_nodes węzłów o największej liczbie odwiedzin
+ * zliczonych przez wyszukiwania opisane przy @ref phfwdProfile i kopiuje je do
+ * jednego bloku w kolejności przechodzenia drzewa w głąb, dzięki czemu często
+ * używane ścieżki zajmują sąsiednie linie pamięci podręcznej. Węzły
+ * przeniesione wcześniej, które nie zostały wybrane, wracają do osobnych
+ * alokacji. Liczniki odwiedzin są zmniejszane o połowę, żeby kolejne
+ * przenoszenie uwzględniało głównie nowe zapytania. Wyniki pozostałych funkcji
+ * nie ulegają zmianie. Funkcja modyfikuje strukturę, więc nie może być
+ * wywoływana współbieżnie z innymi operacjami na niej; można ją wywoływać
+ * okresowo z wątku wykonującego modyfikacje.
+ * @param[in,out] pf    – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] max_nodes – największa liczba przenoszonych węzłów.
+ * @return Liczba węzłów w nowym bloku. Wartość 0, jeśli wskaźnik @p pf ma
+ *         wartość NULL, żaden węzeł nie był odwiedzany lub nie udało się
+ *         alokować pamięci; w tym ostatnim przypadku struktura nie jest zmieniana.
+ */
+size_t phfwdRelocate(PhoneForward *pf, size_t max_nodes);
+
+/** @brief Tworzy stan przyrostowego porządkowania.
+ * Stan zapamiętuje miejsce, w którym @ref phfwdCompact przerwało przechodzenie
+ * struktury. Może być używany tylko z jedną strukturą.
+ * @return Wskaźnik na utworzony stan lub NULL, gdy nie udało się alokować
+ *         pamięci.
+ */
+PhoneForwardCompactor *phfwdCompactorNew(void);
+
+/** @brief Usuwa stan przyrostowego porządkowania.
+ * Nic nie robi, jeśli wskaźnik @p pc ma wartość NULL.
+ * @param[in] pc – wskaźnik na usuwany stan.
+ */
+void phfwdCompactorDelete(PhoneForwardCompactor *pc);
+
+/** @brief Porządkuje strukturę po usunięciach przekierowań.
+ * Usuwa węzły, w których poddrzewach nie ma już żadnych przekierowań, a po
+ * przejściu całej struktury zmniejsza tablicę inwersji i tablicę haszującą
+ * puli numerów, jeżeli są zapełnione w mniej niż jednej czwartej. Jedno
+ * wywołanie wykonuje co najwyżej @p budget kroków, gdzie krokiem jest
+ * odwiedzenie węzła, przeniesienie jednego kubełka tablicy haszującej albo
+ * zmniejszenie tablicy inwersji, i zapamiętuje w @p pc miejsce, od którego
+ * kolejne wywołanie wznowi pracę, więc porządkowanie można przeplatać z innymi
+ * operacjami, wstrzymując je tylko na krótko. Pomiędzy
+ * wywołaniami struktura może być dowolnie zmieniana. Wyniki pozostałych
+ * funkcji nie ulegają zmianie. Funkcja modyfikuje strukturę, więc nie może być
+ * wywoływana współbieżnie z innymi operacjami na niej.
+ * @param[in,out] pf     – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in,out] pc     – wskaźnik na stan porządkowania lub NULL, jeżeli cała
+ *                         struktura ma być uporządkowana w jednym wywołaniu;
+ * @param[in] budget     – największa liczba wykonywanych kroków, co najmniej 1;
+ * @param[out] finished  – wskaźnik, pod który jest zapisywane, czy zakończono
+ *                         przejście całej struktury, lub NULL.
+ * @return Liczba bajtów zwróconych do alokatora struktury.
+ */
+size_t phfwdCompact(PhoneForward *pf, PhoneForwardCompactor *pc, size_t budget, bool *finished);
+
 /** @brief Wyznacza przekierowania na dany numer.
  * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że wynik
  * wywołania @p phfwdGet z numerem @p x zawiera numer @p num, to numer @p x
@@ -216,6 +408,49 @@ PhoneNumbers *phfwdReverse(PhoneForward const *pf, char const *num);
  */
 PhoneNumbers *phfwdGetReverse(PhoneForward const *pf, char const *num);
 
+/** @brief Tworzy pulę wątków.
+ * Pula składa się z @p threads - 1 wątków roboczych; wątek wywołujący funkcje
+ * @ref phfwdReverseParallel i @ref phfwdGetReverseParallel również wykonuje
+ * zadania. Pula może być współdzielona przez wiele wątków, ale ich zlecenia są
+ * wykonywane po kolei.
+ * @param[in] threads – łączna liczba wątków wykonujących zadania.
+ * @return Wskaźnik na utworzoną pulę lub NULL, gdy nie udało się alokować
+ *         pamięci lub utworzyć wątków.
+ */
+PhoneForwardThreadPool *phfwdThreadPoolNew(size_t threads);
+
+/** @brief Usuwa pulę wątków.
+ * Czeka na zakończenie wątków roboczych. Nic nie robi, jeśli wskaźnik @p pool
+ * ma wartość NULL.
+ * @param[in] pool – wskaźnik na usuwaną pulę.
+ */
+void phfwdThreadPoolDelete(PhoneForwardThreadPool *pool);
+
+/** @brief Wyznacza przekierowania na dany numer przy użyciu puli wątków.
+ * Wynik jest taki sam jak wynik wywołania @ref phfwdReverse. Tablica inwersji
+ * jest dzielona na fragmenty, z których wątki wyznaczają posortowane ciągi
+ * kandydatów; ciągi są następnie scalane parami, a każde scalenie jest dzielone
+ * między wątki. Jeśli wskaźnik @p pool ma wartość NULL, wywołuje @ref phfwdReverse.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[in] pool – wskaźnik na pulę wątków.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdReverseParallel(PhoneForward const *pf, char const *num, PhoneForwardThreadPool *pool);
+
+/** @brief Wyznacza przeciwobraz funkcji @p phfwdGet przy użyciu puli wątków.
+ * Wynik jest taki sam jak wynik wywołania @ref phfwdGetReverse. Kandydaci są
+ * sprawdzani przez wątki, które ich wyznaczyły, bez alokowania pamięci. Jeśli
+ * wskaźnik @p pool ma wartość NULL, wywołuje @ref phfwdGetReverse.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[in] pool – wskaźnik na pulę wątków.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdGetReverseParallel(PhoneForward const *pf, char const *num, PhoneForwardThreadPool *pool);
+
 /** @brief Usuwa strukturę.
  * Usuwa strukturę wskazywaną przez @p pnum. Nic nie robi, jeśli wskaźnik ten ma
  * wartość NULL.
@@ -240,4 +475,165 @@ static bool phnumAdd(PhoneNumbers *pnum, const char *num);
  */
 char const *phnumGet(PhoneNumbers const *pnum, size_t idx);
 
+/** @brief Tworzy iterator różnic pomiędzy dwiema strukturami przekierowań.
+ * Iterator przechodzi oba drzewa jednocześnie i pomija poddrzewa, które są tym samym węzłem lub mają równe skróty.
+ * Struktury wskazywane przez @p pf_old i @p pf_new nie mogą być modyfikowane, dopóki iterator jest używany.
+ * Iterator musi być zwolniony za pomocą funkcji @ref phfwdDiffDelete.
+ * @param[in] pf_old – wskaźnik na strukturę przed zmianami;
+ * @param[in] pf_new – wskaźnik na strukturę po zmianach.
+ * @return Wskaźnik na iterator lub NULL, gdy któryś z argumentów ma wartość
+ *         NULL lub nie udało się alokować pamięci.
+ */
+PhoneForwardDiff *phfwdDiffNew(PhoneForward const *pf_old, PhoneForward const *pf_new);
+
+/** @brief Wyznacza kolejną różnicę.
+ * Wyznacza kolejny, w porządku leksykograficznym, prefiks @p num, dla którego przekierowania w obu strukturach się
+ * różnią. Jeżeli przekierowanie zostało dodane, to @p old_fwd ma wartość NULL, a jeżeli zostało usunięte, to
+ * @p new_fwd ma wartość NULL. Udostępnione napisy są ważne do kolejnego wywołania funkcji lub do modyfikacji
+ * którejś ze struktur.
+ * @param[in,out] diff  – wskaźnik na iterator;
+ * @param[out] num      – wskaźnik na prefiks numerów przekierowywanych;
+ * @param[out] old_fwd  – wskaźnik na przekierowanie w strukturze przed zmianami;
+ * @param[out] new_fwd  – wskaźnik na przekierowanie w strukturze po zmianach.
+ * @return Wartość @p true, jeśli wyznaczono kolejną różnicę.
+ *         Wartość @p false, jeśli różnic już nie ma lub nie udało się alokować pamięci; te przypadki rozróżnia
+ *         funkcja @ref phfwdDiffFailed. Po błędzie kolejne wywołania również zwracają @p false.
+ */
+bool phfwdDiffNext(PhoneForwardDiff *diff, char const **num, char const **old_fwd, char const **new_fwd);
+
+/** @brief Sprawdza, czy wyznaczanie różnic zostało przerwane z braku pamięci.
+ * Wyznaczone różnice są kompletne tylko wtedy, gdy @ref phfwdDiffNext zwróciło @p false, a ta funkcja zwraca
+ * @p false.
+ * @param[in] diff – wskaźnik na iterator.
+ * @return Wartość @p true, jeśli nie udało się alokować pamięci w którymś wywołaniu @ref phfwdDiffNext.
+ *         Wartość @p false w przeciwnym przypadku lub jeśli wskaźnik @p diff ma wartość NULL.
+ */
+bool phfwdDiffFailed(PhoneForwardDiff const *diff);
+
+/** @brief Usuwa iterator różnic.
+ * Usuwa strukturę wskazywaną przez @p diff. Nic nie robi, jeśli wskaźnik ten ma
+ * wartość NULL.
+ * @param[in] diff – wskaźnik na usuwany iterator.
+ */
+void phfwdDiffDelete(PhoneForwardDiff *diff);
+
+/** @brief Zamraża strukturę przekierowań.
+ * Tworzy zwartą, przeznaczoną tylko do odczytu kopię struktury wskazywanej przez @p pf: węzły drzewa trie są
+ * umieszczone w jednej tablicy w kolejności przechodzenia wszerz, zbiory dzieci są zapisane jako mapy bitowe, a
+ * wszystkie numery są przechowywane jednokrotnie we wspólnej puli napisów. Późniejsze zmiany @p pf nie są widoczne
+ * w zamrożonej strukturze. Struktura musi być zwolniona za pomocą funkcji @ref phfwdFrozenDelete.
+ * @param[in] pf – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na zamrożoną strukturę lub NULL, gdy @p pf ma wartość NULL
+ *         lub nie udało się alokować pamięci.
+ */
+PhoneForwardFrozen *phfwdFreeze(PhoneForward const *pf);
+
+/** @brief Usuwa zamrożoną strukturę.
+ * Usuwa strukturę wskazywaną przez @p pff. Nic nie robi, jeśli wskaźnik ten ma
+ * wartość NULL.
+ * @param[in] pff – wskaźnik na usuwaną strukturę.
+ */
+void phfwdFrozenDelete(PhoneForwardFrozen *pff);
+
+/** @brief Wyznacza przekierowanie numeru w zamrożonej strukturze bez alokowania pamięci.
+ * Zapisuje do bufora @p buf wynik, jaki dałoby wywołanie @ref phfwdGet dla struktury, z której powstała @p pff.
+ * Zapisuje co najwyżej @p size znaków łącznie z kończącym znakiem '\0', podobnie jak funkcja snprintf.
+ * @param[in] pff  – wskaźnik na zamrożoną strukturę;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[out] buf – wskaźnik na bufor na wynik, może mieć wartość NULL, jeżeli @p size jest równe 0;
+ * @param[in] size – rozmiar bufora.
+ * @return Długość wynikowego numeru lub 0, jeżeli podany napis nie reprezentuje numeru.
+ */
+size_t phfwdFrozenGetInto(PhoneForwardFrozen const *pff, char const *num, char *buf, size_t size);
+
+/** @brief Wyznacza przekierowanie numeru w zamrożonej strukturze.
+ * Działa jak @ref phfwdGet dla struktury, z której powstała @p pff.
+ * @param[in] pff – wskaźnik na zamrożoną strukturę;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdFrozenGet(PhoneForwardFrozen const *pff, char const *num);
+
+/** @brief Wyznacza przekierowania na dany numer w zamrożonej strukturze.
+ * Działa jak @ref phfwdReverse dla struktury, z której powstała @p pff. Zamiast przeglądać wszystkie inwersje,
+ * wyszukuje binarnie inwersje dla każdego prefiksu numeru @p num.
+ * @param[in] pff – wskaźnik na zamrożoną strukturę;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdFrozenReverse(PhoneForwardFrozen const *pff, char const *num);
+
+/** @brief Tworzy nakładkę na strukturę przekierowań.
+ * Nakładka przechowuje tylko własne zmiany: dodane przekierowania oraz usunięte
+ * prefiksy. Wyniki zapytań są takie, jakby zmiany zostały wykonane na kopii
+ * struktury @p base. Wiele nakładek może współdzielić jedną bazę. Baza nie może
+ * być zmieniana ani usunięta, dopóki istnieją jej nakładki.
+ * @param[in] base – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na utworzoną nakładkę lub NULL, gdy wskaźnik @p base ma
+ *         wartość NULL lub nie udało się alokować pamięci.
+ */
+PhoneForwardOverlay *phfwdOverlayNew(PhoneForward const *base);
+
+/** @brief Usuwa nakładkę.
+ * Nie zmienia bazy. Nic nie robi, jeśli wskaźnik @p ov ma wartość NULL.
+ * @param[in] ov – wskaźnik na usuwaną nakładkę.
+ */
+void phfwdOverlayDelete(PhoneForwardOverlay *ov);
+
+/** @brief Dodaje przekierowanie w nakładce.
+ * Działa jak @ref phfwdAdd wykonane na nakładce; baza nie jest zmieniana.
+ * @param[in,out] ov – wskaźnik na nakładkę;
+ * @param[in] num1   – wskaźnik na napis reprezentujący prefiks numerów
+ *                     przekierowywanych;
+ * @param[in] num2   – wskaźnik na napis reprezentujący prefiks numerów,
+ *                     na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane.
+ *         Wartość @p false, jeśli wystąpił błąd, np. podany napis nie
+ *         reprezentuje numeru, oba podane numery są identyczne lub nie udało
+ *         się alokować pamięci.
+ */
+bool phfwdOverlayAdd(PhoneForwardOverlay *ov, char const *num1, char const *num2);
+
+/** @brief Usuwa przekierowania w nakładce.
+ * Działa jak @ref phfwdRemove wykonane na nakładce: usuwa przekierowania
+ * dodane w nakładce oraz przesłania przekierowania bazy wszystkich numerów
+ * o prefiksie @p num.
+ * @param[in,out] ov – wskaźnik na nakładkę;
+ * @param[in] num    – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli przekierowania zostały usunięte.
+ *         Wartość @p false, jeśli podany napis nie reprezentuje numeru lub nie
+ *         udało się alokować pamięci; wtedy nakładka nie jest zmieniana.
+ */
+bool phfwdOverlayRemove(PhoneForwardOverlay *ov, char const *num);
+
+/** @brief Wyznacza przekierowanie numeru w nakładce.
+ * Wynik jest taki sam jak wynik @ref phfwdGet dla bazy ze zmianami nakładki.
+ * @param[in] ov  – wskaźnik na nakładkę;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdOverlayGet(PhoneForwardOverlay const *ov, char const *num);
+
+/** @brief Wyznacza przekierowania na dany numer w nakładce.
+ * Wynik jest taki sam jak wynik @ref phfwdReverse dla bazy ze zmianami nakładki.
+ * @param[in] ov  – wskaźnik na nakładkę;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdOverlayReverse(PhoneForwardOverlay const *ov, char const *num);
+
+/** @brief Wyznacza przeciwobraz funkcji @ref phfwdOverlayGet dla danego numeru.
+ * Wynik jest taki sam jak wynik @ref phfwdGetReverse dla bazy ze zmianami
+ * nakładki.
+ * @param[in] ov  – wskaźnik na nakładkę;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers *phfwdOverlayGetReverse(PhoneForwardOverlay const *ov, char const *num);
+
 #endif /* __PHONE_FORWARD_H__ */
@@ -0,0 +1,277 @@
+/** @file
+ * Implementacja areny pamięci dla struktury przechowującej przekierowania numerów telefonów
+ *
+ * Arena pobiera pamięć od systemu w blokach po 2 MiB i wydziela z nich małe obiekty, zwolnione obiekty trafiają
+ * na listy wolnych obiektów według rozmiaru. Duże obiekty, np. tablica inwersji, są odwzorowywane osobno i
+ * powiększane przez mremap. Suma odwzorowanej pamięci nigdy nie przekracza budżetu areny.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#define _GNU_SOURCE
+
+#include "phone_forward.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/** @brief Rozmiar bloku pamięci pobieranego od systemu, równy rozmiarowi dużej strony.
+ */
+#define ARENA_CHUNK_SIZE ((size_t) 2 << 20)
+
+/** @brief Wyrównanie i ziarnistość rozmiarów małych obiektów.
+ */
+#define ARENA_ALIGN 16
+
+/** @brief Największy rozmiar małego obiektu.
+ */
+#define ARENA_SMALL_LIMIT 1024
+
+/** @brief Liczba klas rozmiarów małych obiektów.
+ */
+#define ARENA_CLASSES (ARENA_SMALL_LIMIT / ARENA_ALIGN)
+
+/** @brief Rozmiar nagłówka bloku i dużego obiektu, zachowujący wyrównanie do linii pamięci podręcznej.
+ */
+#define ARENA_HEADER_SIZE 64
+
+/** @brief Rozmiar strony pamięci.
+ */
+#define ARENA_PAGE_SIZE ((size_t) 4096)
+
+/** @brief Nagłówek osobno odwzorowanego dużego obiektu.
+ */
+typedef struct ArenaLarge {
+    //! Poprzedni duży obiekt areny.
+    struct ArenaLarge *prev;
+    //! Następny duży obiekt areny.
+    struct ArenaLarge *next;
+    //! Rozmiar odwzorowania łącznie z nagłówkiem.
+    size_t mapped;
+} ArenaLarge;
+
+/** @brief Struktura areny pamięci.
+ */
+struct PhoneForwardArena {
+    //! Maksymalna łączna wielkość odwzorowanej pamięci lub 0, jeżeli nie ma ograniczenia.
+    size_t budget;
+    //! Łączna wielkość odwzorowanej pamięci.
+    size_t mapped;
+    //! Łączna wielkość przydzielonych obiektów, po zaokrągleniu do klasy rozmiaru.
+    size_t in_use;
+    //! Czy pamięć ma być odwzorowywana dużymi stronami.
+    bool hugepages;
+    //! Pierwszy wolny bajt aktualnego bloku.
+    char *chunk_pos;
+    //! Koniec aktualnego bloku.
+    char *chunk_end;
+    //! Lista bloków, na początku każdego bloku jest wskaźnik na poprzedni blok.
+    void *chunks;
+    //! Listy wolnych małych obiektów według klasy rozmiaru.
+    void *free_lists[ARENA_CLASSES];
+    //! Lista dużych obiektów.
+    ArenaLarge *large;
+};
+
+/** @brief Zaokrągla @p size w górę do wielokrotności @p align.
+ * @param size - zaokrąglana wartość.
+ * @param align - potęga dwójki.
+ * @return Zaokrąglona wartość.
+ */
+static size_t arenaRound(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+/** @brief Odwzorowuje @p size bajtów pamięci w ramach budżetu areny.
+ * Jeżeli arena używa dużych stron, najpierw próbuje MAP_HUGETLB, a gdy ta się nie powiedzie, odwzorowuje pamięć
+ * wyrównaną do 2 MiB i zaleca jądru użycie przezroczystych dużych stron.
+ * @param arena - wskaźnik na arenę.
+ * @param size - rozmiar, wielokrotność rozmiaru strony.
+ * @return Wskaźnik na odwzorowaną pamięć lub NULL, gdy przekroczyłoby to budżet lub odwzorowanie się nie powiodło.
+ */
+static void *arenaMap(PhoneForwardArena *arena, size_t size) {
+    if (arena->budget != 0 && (size > arena->budget || arena->mapped > arena->budget - size)) return NULL;
+
+    void *mem = MAP_FAILED;
+    if (arena->hugepages && size % ARENA_CHUNK_SIZE == 0) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (mem == MAP_FAILED && arena->hugepages && size >= ARENA_CHUNK_SIZE) {
+        // Nadmiarowe odwzorowanie pozwala wyciąć fragment wyrównany do granicy dużej strony.
+        char *raw = mmap(NULL, size + ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            char *aligned = (char *) arenaRound((uintptr_t) raw, ARENA_CHUNK_SIZE);
+            if (aligned > raw) munmap(raw, (size_t) (aligned - raw));
+            munmap(aligned + size, (size_t) (raw + ARENA_CHUNK_SIZE - aligned));
+            madvise(aligned, size, MADV_HUGEPAGE);
+            mem = aligned;
+        }
+    }
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (mem == MAP_FAILED) return NULL;
+
+    arena->mapped += size;
+    return mem;
+}
+
+/** @brief Przydziela pamięć z areny.
+ * @param ctx - wskaźnik na arenę.
+ * @param size - rozmiar obiektu.
+ * @return Wskaźnik na przydzieloną pamięć lub NULL, gdy przekroczyłoby to budżet.
+ */
+static void *arenaAlloc(void *ctx, size_t size) {
+    PhoneForwardArena *arena = ctx;
+
+    if (size <= ARENA_SMALL_LIMIT) {
+        size_t rounded = size == 0 ? ARENA_ALIGN : arenaRound(size, ARENA_ALIGN);
+        size_t cls = rounded / ARENA_ALIGN - 1;
+        void *obj = arena->free_lists[cls];
+        if (obj != NULL) {
+            arena->free_lists[cls] = *(void **) obj;
+        } else {
+            if (arena->chunk_pos == NULL || (size_t) (arena->chunk_end - arena->chunk_pos) < rounded) {
+                char *chunk = arenaMap(arena, ARENA_CHUNK_SIZE);
+                if (chunk == NULL) return NULL;
+                *(void **) chunk = arena->chunks;
+                arena->chunks = chunk;
+                arena->chunk_pos = chunk + ARENA_HEADER_SIZE;
+                arena->chunk_end = chunk + ARENA_CHUNK_SIZE;
+            }
+            obj = arena->chunk_pos;
+            arena->chunk_pos += rounded;
+        }
+        arena->in_use += rounded;
+        return obj;
+    }
+
+    size_t mapped = arenaRound(size + ARENA_HEADER_SIZE, ARENA_PAGE_SIZE);
+    ArenaLarge *large = arenaMap(arena, mapped);
+    if (large == NULL) return NULL;
+
+    large->prev = NULL;
+    large->next = arena->large;
+    large->mapped = mapped;
+    if (arena->large != NULL) arena->large->prev = large;
+    arena->large = large;
+    arena->in_use += mapped;
+    return (char *) large + ARENA_HEADER_SIZE;
+}
+
+/** @brief Zwraca obiekt do areny.
+ * @param ctx - wskaźnik na arenę.
+ * @param ptr - wskaźnik na obiekt.
+ * @param size - rozmiar obiektu podany przy przydzieleniu.
+ */
+static void arenaFree(void *ctx, void *ptr, size_t size) {
+    PhoneForwardArena *arena = ctx;
+    if (ptr == NULL) return;
+
+    if (size <= ARENA_SMALL_LIMIT) {
+        size_t rounded = size == 0 ? ARENA_ALIGN : arenaRound(size, ARENA_ALIGN);
+        size_t cls = rounded / ARENA_ALIGN - 1;
+        *(void **) ptr = arena->free_lists[cls];
+        arena->free_lists[cls] = ptr;
+        arena->in_use -= rounded;
+        return;
+    }
+
+    ArenaLarge *large = (ArenaLarge *) ((char *) ptr - ARENA_HEADER_SIZE);
+    if (large->prev != NULL) {
+        large->prev->next = large->next;
+    } else {
+        arena->large = large->next;
+    }
+    if (large->next != NULL) large->next->prev = large->prev;
+    arena->mapped -= large->mapped;
+    arena->in_use -= large->mapped;
+    munmap(large, large->mapped);
+}
+
+/** @brief Zmienia rozmiar obiektu z areny.
+ * @param ctx - wskaźnik na arenę.
+ * @param ptr - wskaźnik na obiekt.
+ * @param old_size - dotychczasowy rozmiar obiektu.
+ * @param new_size - nowy rozmiar obiektu.
+ * @return Wskaźnik na obiekt o nowym rozmiarze lub NULL, gdy przekroczyłoby to budżet. W tym drugim przypadku
+ * dotychczasowy obiekt pozostaje ważny.
+ */
+static void *arenaRealloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    PhoneForwardArena *arena = ctx;
+    if (ptr == NULL) return arenaAlloc(ctx, new_size);
+
+    if (old_size > ARENA_SMALL_LIMIT && new_size > ARENA_SMALL_LIMIT) {
+        ArenaLarge *large = (ArenaLarge *) ((char *) ptr - ARENA_HEADER_SIZE);
+        size_t mapped = arenaRound(new_size + ARENA_HEADER_SIZE, ARENA_PAGE_SIZE);
+        if (mapped == large->mapped) return ptr;
+        if (mapped > large->mapped && arena->budget != 0 && arena->mapped + (mapped - large->mapped) > arena->budget) {
+            return NULL;
+        }
+
+        ArenaLarge *moved = mremap(large, large->mapped, mapped, MREMAP_MAYMOVE);
+        if (moved == MAP_FAILED) return NULL;
+        arena->mapped = arena->mapped - moved->mapped + mapped;
+        arena->in_use = arena->in_use - moved->mapped + mapped;
+        moved->mapped = mapped;
+        if (moved->prev != NULL) {
+            moved->prev->next = moved;
+        } else {
+            arena->large = moved;
+        }
+        if (moved->next != NULL) moved->next->prev = moved;
+        if (arena->hugepages && mapped >= ARENA_CHUNK_SIZE) madvise(moved, mapped, MADV_HUGEPAGE);
+        return (char *) moved + ARENA_HEADER_SIZE;
+    }
+
+    if (old_size <= ARENA_SMALL_LIMIT && new_size <= ARENA_SMALL_LIMIT &&
+        arenaRound(old_size, ARENA_ALIGN) == arenaRound(new_size, ARENA_ALIGN) && old_size != 0) {
+        return ptr;
+    }
+
+    void *new_ptr = arenaAlloc(ctx, new_size);
+    if (new_ptr == NULL) return NULL;
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    arenaFree(ctx, ptr, old_size);
+    return new_ptr;
+}
+
+PhoneForwardArena *phfwdArenaNew(size_t budget, bool hugepages) {
+    PhoneForwardArena *arena = calloc(1, sizeof(PhoneForwardArena));
+    if (arena == NULL) return NULL;
+
+    arena->budget = budget;
+    arena->hugepages = hugepages;
+    return arena;
+}
+
+void phfwdArenaDelete(PhoneForwardArena *arena) {
+    if (arena == NULL) return;
+
+    while (arena->chunks != NULL) {
+        void *prev = *(void **) arena->chunks;
+        munmap(arena->chunks, ARENA_CHUNK_SIZE);
+        arena->chunks = prev;
+    }
+    while (arena->large != NULL) {
+        ArenaLarge *next = arena->large->next;
+        munmap(arena->large, arena->large->mapped);
+        arena->large = next;
+    }
+    free(arena);
+}
+
+PhoneForwardAllocator phfwdArenaAllocator(PhoneForwardArena *arena) {
+    PhoneForwardAllocator allocator = {arenaAlloc, arenaRealloc, arenaFree, arena};
+    return allocator;
+}
+
+size_t phfwdArenaMapped(PhoneForwardArena const *arena) {
+    return arena == NULL ? 0 : arena->mapped;
+}
+
+size_t phfwdArenaInUse(PhoneForwardArena const *arena) {
+    return arena == NULL ? 0 : arena->in_use;
+}
@@ -0,0 +1,730 @@
+/** @file
+ * Pomiary wydajności operacji na strukturze przechowującej przekierowania numerów telefonów
+ *
+ * Użycie: phone_forward_bench [liczba przekierowań] [liczba zapytań] [pomiar]
+ *
+ * Bez podania pomiaru wykonywane są wszystkie pomiary. Program phone_forward_bench_digits jest zbudowany w wariancie
+ * dla numerów złożonych wyłącznie z cyfr 0-9.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#define _GNU_SOURCE
+
+#include "phone_forward.h"
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @brief Maksymalna długość numerów używanych w pomiarach.
+ */
+#define BENCH_MAX_LEN 15
+
+/** @brief Stan generatora liczb pseudolosowych.
+ */
+static uint64_t bench_seed = 0x2545f4914f6cdd1dULL;
+
+/** @brief Zwraca kolejną liczbę pseudolosową (xorshift64).
+ * @return Liczba pseudolosowa.
+ */
+static uint64_t benchRand(void) {
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 7;
+    bench_seed ^= bench_seed << 17;
+    return bench_seed;
+}
+
+/** @brief Zapisuje do @p num losowy numer składający się z cyfr dziesiętnych.
+ * @param num - wskaźnik na bufor o rozmiarze co najmniej @p max_len + 1.
+ * @param min_len - minimalna długość numeru.
+ * @param max_len - maksymalna długość numeru.
+ */
+static void benchRandomNumber(char *num, size_t min_len, size_t max_len) {
+    size_t len = min_len + benchRand() % (max_len - min_len + 1);
+    for (size_t i = 0; i < len; i++) {
+        num[i] = (char) ('0' + benchRand() % 10);
+    }
+    num[len] = '\0';
+}
+
+/** @brief Zwraca aktualny czas w sekundach.
+ * @return Czas w sekundach.
+ */
+static double benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/** @brief Wypisuje wynik pomiaru.
+ * @param name - nazwa mierzonej operacji.
+ * @param ops - liczba wykonanych operacji.
+ * @param seconds - czas wykonania.
+ */
+static void benchReport(const char *name, size_t ops, double seconds) {
+    printf("%-32s %10zu ops %10.3f s %10.1f ns/op\n", name, ops, seconds, seconds * 1e9 / (double) ops);
+}
+
+/** @brief Otwiera licznik sprzętowy procesora dla bieżącego wątku.
+ * @param type - typ licznika perf_event.
+ * @param config - konfiguracja licznika perf_event.
+ * @return Deskryptor licznika lub -1, gdy liczniki nie są dostępne.
+ */
+static int benchCounterOpen(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/** @brief Zeruje i włącza licznik.
+ * @param fd - deskryptor licznika lub -1.
+ */
+static void benchCounterStart(int fd) {
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/** @brief Wyłącza licznik i zwraca jego wartość.
+ * @param fd - deskryptor licznika lub -1.
+ * @return Wartość licznika lub -1, gdy licznik nie jest dostępny.
+ */
+static long long benchCounterStop(int fd) {
+    long long value = -1;
+    if (fd < 0) return value;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &value, sizeof value) != sizeof value) value = -1;
+    return value;
+}
+
+/** @brief Tworzy strukturę z @p amount losowymi przekierowaniami korzystającą z podanego alokatora.
+ * @param amount - liczba przekierowań.
+ * @param allocator - wskaźnik na alokator lub NULL dla alokatora domyślnego.
+ * @return Wskaźnik na utworzoną strukturę.
+ */
+static PhoneForward *benchBuildWith(size_t amount, const PhoneForwardAllocator *allocator) {
+    char num1[BENCH_MAX_LEN + 1], num2[BENCH_MAX_LEN + 1];
+    PhoneForward *pf = allocator == NULL ? phfwdNew() : phfwdNewWithAllocator(allocator);
+    if (pf == NULL) return NULL;
+
+    bench_seed = 0x2545f4914f6cdd1dULL;
+    for (size_t i = 0; i < amount; i++) {
+        benchRandomNumber(num1, 4, 9);
+        benchRandomNumber(num2, 1, 6);
+        phfwdAdd(pf, num1, num2);
+    }
+    return pf;
+}
+
+/** @brief Tworzy strukturę z @p amount losowymi przekierowaniami.
+ * @param amount - liczba przekierowań.
+ * @return Wskaźnik na utworzoną strukturę.
+ */
+static PhoneForward *benchBuild(size_t amount) {
+    return benchBuildWith(amount, NULL);
+}
+
+/** @brief Porównuje wyszukiwanie przekierowań w drzewie wskaźnikowym i w zamrożonej strukturze.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param queries - liczba zapytań.
+ */
+static void benchFrozen(PhoneForward *pf, size_t queries) {
+    char num[BENCH_MAX_LEN + 1], buf[2 * BENCH_MAX_LEN + 1];
+    size_t checksum = 0;
+
+    double start = benchNow();
+    PhoneForwardFrozen *pff = phfwdFreeze(pf);
+    benchReport("phfwdFreeze", 1, benchNow() - start);
+    if (pff == NULL) return;
+
+    bench_seed = 42;
+    start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        benchRandomNumber(num, 12, 12);
+        PhoneNumbers *pnum = phfwdGet(pf, num);
+        checksum += phnumGet(pnum, 0)[0];
+        phnumDelete(pnum);
+    }
+    benchReport("phfwdGet", queries, benchNow() - start);
+
+    bench_seed = 42;
+    start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        benchRandomNumber(num, 12, 12);
+        PhoneNumbers *pnum = phfwdFrozenGet(pff, num);
+        checksum -= phnumGet(pnum, 0)[0];
+        phnumDelete(pnum);
+    }
+    benchReport("phfwdFrozenGet", queries, benchNow() - start);
+
+    bench_seed = 42;
+    start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        benchRandomNumber(num, 12, 12);
+        phfwdFrozenGetInto(pff, num, buf, sizeof buf);
+        checksum += buf[0];
+    }
+    benchReport("phfwdFrozenGetInto", queries, benchNow() - start);
+
+    size_t reverse_queries = queries / 1000 + 1;
+    bench_seed = 7;
+    start = benchNow();
+    for (size_t i = 0; i < reverse_queries; i++) {
+        benchRandomNumber(num, 8, 8);
+        PhoneNumbers *pnum = phfwdReverse(pf, num);
+        checksum += phnumGet(pnum, 0)[0];
+        phnumDelete(pnum);
+    }
+    benchReport("phfwdReverse", reverse_queries, benchNow() - start);
+
+    bench_seed = 7;
+    start = benchNow();
+    for (size_t i = 0; i < reverse_queries; i++) {
+        benchRandomNumber(num, 8, 8);
+        PhoneNumbers *pnum = phfwdFrozenReverse(pff, num);
+        checksum -= phnumGet(pnum, 0)[0];
+        phnumDelete(pnum);
+    }
+    benchReport("phfwdFrozenReverse", reverse_queries, benchNow() - start);
+
+    printf("checksum %zu\n", checksum);
+    phfwdFrozenDelete(pff);
+}
+
+/** @brief Porównuje zapytania wykonywane po kolei z zapytaniami wykonywanymi z przeplotem przez phfwdGetBatch.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param queries - liczba zapytań.
+ */
+static void benchBatch(PhoneForward *pf, size_t queries) {
+    const size_t batch = 1024;
+    char (*nums)[BENCH_MAX_LEN + 1] = malloc(queries * sizeof *nums);
+    const char **ptrs = malloc(queries * sizeof(char *));
+    PhoneNumbers **results = malloc(batch * sizeof(PhoneNumbers *));
+    if (nums == NULL || ptrs == NULL || results == NULL) {
+        free(nums);
+        free(ptrs);
+        free(results);
+        return;
+    }
+
+    bench_seed = 99;
+    for (size_t i = 0; i < queries; i++) {
+        benchRandomNumber(nums[i], 12, 12);
+        ptrs[i] = nums[i];
+    }
+
+    size_t checksum = 0;
+    double start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        PhoneNumbers *pnum = phfwdGet(pf, ptrs[i]);
+        checksum += phnumGet(pnum, 0)[1];
+        phnumDelete(pnum);
+    }
+    double serial = benchNow() - start;
+    benchReport("phfwdGet serial", queries, serial);
+
+    start = benchNow();
+    for (size_t i = 0; i < queries; i += batch) {
+        size_t count = queries - i < batch ? queries - i : batch;
+        if (!phfwdGetBatch(pf, ptrs + i, count, results)) break;
+        for (size_t j = 0; j < count; j++) {
+            checksum -= phnumGet(results[j], 0)[1];
+            phnumDelete(results[j]);
+        }
+    }
+    double interleaved = benchNow() - start;
+    benchReport("phfwdGetBatch", queries, interleaved);
+    printf("%-32s %10.2fx (checksum %zu)\n", "batch speedup", serial / interleaved, checksum);
+
+    free(nums);
+    free(ptrs);
+    free(results);
+}
+
+/** @brief Porównuje wyszukiwanie w strukturach z pamięcią z malloc, z areny oraz z areny na dużych stronach.
+ * Wypisuje liczbę chybień w TLB danych, jeżeli liczniki sprzętowe są dostępne.
+ * @param amount - liczba przekierowań.
+ * @param queries - liczba zapytań.
+ */
+static void benchArena(size_t amount, size_t queries) {
+    static const char *names[] = {"lookup malloc", "lookup arena", "lookup arena hugepages"};
+    char num[BENCH_MAX_LEN + 1];
+    int counter = benchCounterOpen(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    for (int variant = 0; variant < 3; variant++) {
+        PhoneForwardArena *arena = variant == 0 ? NULL : phfwdArenaNew(0, variant == 2);
+        PhoneForwardAllocator allocator = phfwdArenaAllocator(arena);
+        PhoneForward *pf = benchBuildWith(amount, arena == NULL ? NULL : &allocator);
+        if (pf == NULL) {
+            phfwdArenaDelete(arena);
+            continue;
+        }
+
+        size_t checksum = 0;
+        bench_seed = 42;
+        benchCounterStart(counter);
+        double start = benchNow();
+        for (size_t i = 0; i < queries; i++) {
+            benchRandomNumber(num, 12, 12);
+            PhoneNumbers *pnum = phfwdGet(pf, num);
+            checksum += phnumGet(pnum, 0)[0];
+            phnumDelete(pnum);
+        }
+        double seconds = benchNow() - start;
+        long long misses = benchCounterStop(counter);
+
+        benchReport(names[variant], queries, seconds);
+        if (misses >= 0) {
+            printf("%-32s %10.3f dTLB misses/op\n", "", (double) misses / (double) queries);
+        } else {
+            printf("%-32s %10s dTLB misses/op (counters unavailable)\n", "", "n/a");
+        }
+        if (arena != NULL) printf("%-32s %10zu B mapped\n", "", phfwdArenaMapped(arena));
+        (void) checksum;
+
+        phfwdDelete(pf);
+        phfwdArenaDelete(arena);
+    }
+    if (counter >= 0) close(counter);
+}
+
+/** @brief Mierzy pamięć zajmowaną przez strukturę, w której wiele prefiksów jest przekierowywanych na kilka numerów.
+ * @param amount - liczba przekierowań.
+ * @param targets - liczba różnych numerów, na które są wykonywane przekierowania.
+ */
+static void benchFanIn(size_t amount, size_t targets) {
+    char num1[BENCH_MAX_LEN + 1], num2[BENCH_MAX_LEN + 1];
+
+    size_t heap_before = mallinfo2().uordblks;
+    PhoneForward *pf = phfwdNew();
+    if (pf == NULL) return;
+
+    bench_seed = 1234;
+    for (size_t i = 0; i < amount; i++) {
+        benchRandomNumber(num1, 6, 9);
+        snprintf(num2, sizeof num2, "80012345%04zu", i % targets);
+        phfwdAdd(pf, num1, num2);
+    }
+    size_t heap = mallinfo2().uordblks - heap_before;
+    printf("%-32s %10zu fwd %10zu tgt %10zu B %10.1f B/fwd\n", "fan-in heap", amount, targets, heap,
+           (double) heap / (double) amount);
+    phfwdDelete(pf);
+}
+
+/** @brief Wykonuje zapytania i wypisuje czas oraz liczbę chybień w pamięci podręcznej i TLB danych.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param nums - tablica numerów.
+ * @param queries - liczba zapytań.
+ * @param name - nazwa pomiaru.
+ * @return Suma kontrolna wyników.
+ */
+static size_t benchSkewedRun(PhoneForward *pf, char (*nums)[BENCH_MAX_LEN + 1], size_t queries, const char *name) {
+    int cache = benchCounterOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int tlb = benchCounterOpen(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    size_t checksum = 0;
+
+    benchCounterStart(cache);
+    benchCounterStart(tlb);
+    double start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        PhoneNumbers *pnum = phfwdGet(pf, nums[i]);
+        const char *res = phnumGet(pnum, 0);
+        checksum = checksum * 31 + res[0] + res[strlen(res) - 1];
+        phnumDelete(pnum);
+    }
+    double seconds = benchNow() - start;
+    long long cache_misses = benchCounterStop(cache);
+    long long tlb_misses = benchCounterStop(tlb);
+
+    benchReport(name, queries, seconds);
+    if (cache_misses >= 0 && tlb_misses >= 0) {
+        printf("%-32s %10.3f cache misses/op %10.3f dTLB misses/op\n", "", (double) cache_misses / (double) queries,
+               (double) tlb_misses / (double) queries);
+    } else {
+        printf("%-32s %10s cache misses/op (counters unavailable)\n", "", "n/a");
+    }
+    if (cache >= 0) close(cache);
+    if (tlb >= 0) close(tlb);
+    return checksum;
+}
+
+/** @brief Porównuje wyszukiwanie przy skośnym rozkładzie zapytań przed i po przeniesieniu gorących węzłów.
+ * Dziewięć na dziesięć zapytań dotyczy jednego z niewielkiego zbioru numerów, pozostałe są losowe.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param queries - liczba zapytań.
+ */
+static void benchRelocate(PhoneForward *pf, size_t queries) {
+    const size_t hot_amount = 4096;
+    char (*hot)[BENCH_MAX_LEN + 1] = malloc(hot_amount * sizeof *hot);
+    char (*nums)[BENCH_MAX_LEN + 1] = malloc(queries * sizeof *nums);
+    if (hot == NULL || nums == NULL) {
+        free(hot);
+        free(nums);
+        return;
+    }
+
+    bench_seed = 2024;
+    for (size_t i = 0; i < hot_amount; i++) {
+        benchRandomNumber(hot[i], 12, 12);
+    }
+    for (size_t i = 0; i < queries; i++) {
+        if (benchRand() % 10 != 0) {
+            strcpy(nums[i], hot[benchRand() % hot_amount]);
+        } else {
+            benchRandomNumber(nums[i], 12, 12);
+        }
+    }
+
+    size_t before = benchSkewedRun(pf, nums, queries, "skewed phfwdGet scattered");
+
+    phfwdProfile(pf, true);
+    double start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        phnumDelete(phfwdGet(pf, nums[i]));
+    }
+    benchReport("skewed phfwdGet profiling", queries, benchNow() - start);
+    phfwdProfile(pf, false);
+
+    start = benchNow();
+    size_t packed = phfwdRelocate(pf, 16 * hot_amount);
+    benchReport("phfwdRelocate", 1, benchNow() - start);
+    printf("%-32s %10zu nodes packed\n", "", packed);
+
+    size_t after = benchSkewedRun(pf, nums, queries, "skewed phfwdGet packed");
+    if (before != after) printf("  RESULT MISMATCH\n");
+
+    free(hot);
+    free(nums);
+}
+
+/** @brief Sprawdza, czy dwa ciągi numerów są równe.
+ * @param a - wskaźnik na pierwszy ciąg.
+ * @param b - wskaźnik na drugi ciąg.
+ * @return Wartość @p true, jeśli ciągi są równe, lub @p false w przeciwnym wypadku.
+ */
+static bool benchSameNumbers(PhoneNumbers const *a, PhoneNumbers const *b) {
+    for (size_t i = 0;; i++) {
+        const char *x = phnumGet(a, i);
+        const char *y = phnumGet(b, i);
+        if (x == NULL || y == NULL) return x == y;
+        if (strcmp(x, y) != 0) return false;
+    }
+}
+
+/** @brief Porównuje nakładki na współdzieloną bazę z pełnymi kopiami struktury dla kilku klientów.
+ * Każdy klient zmienia @p overrides przekierowań bazy i usuwa kilka prefiksów. Wypisuje pamięć zajmowaną przez
+ * jednego klienta oraz czas wyszukiwania w nakładce i w pełnej kopii.
+ * @param amount - liczba przekierowań bazy.
+ * @param queries - liczba zapytań.
+ * @param overrides - liczba zmian jednego klienta.
+ */
+static void benchOverlay(size_t amount, size_t queries, size_t overrides) {
+    const size_t tenants = 4;
+    char num1[BENCH_MAX_LEN + 1], num2[BENCH_MAX_LEN + 1];
+
+    PhoneForward *base = benchBuild(amount);
+    if (base == NULL) return;
+
+    size_t heap_before = mallinfo2().uordblks;
+    PhoneForwardOverlay *overlays[4];
+    for (size_t t = 0; t < tenants; t++) {
+        overlays[t] = phfwdOverlayNew(base);
+        bench_seed = 100 + t;
+        for (size_t i = 0; overlays[t] != NULL && i < overrides; i++) {
+            benchRandomNumber(num1, 4, 9);
+            benchRandomNumber(num2, 1, 6);
+            if (i % 100 == 0) {
+                phfwdOverlayRemove(overlays[t], num1);
+            } else {
+                phfwdOverlayAdd(overlays[t], num1, num2);
+            }
+        }
+    }
+    size_t overlay_heap = mallinfo2().uordblks - heap_before;
+
+    // Pełna kopia pierwszego klienta: baza odbudowana od zera ze zmianami klienta.
+    heap_before = mallinfo2().uordblks;
+    PhoneForward *copy = benchBuild(amount);
+    bench_seed = 100;
+    for (size_t i = 0; copy != NULL && i < overrides; i++) {
+        benchRandomNumber(num1, 4, 9);
+        benchRandomNumber(num2, 1, 6);
+        if (i % 100 == 0) {
+            phfwdRemove(copy, num1);
+        } else {
+            phfwdAdd(copy, num1, num2);
+        }
+    }
+    size_t copy_heap = mallinfo2().uordblks - heap_before;
+
+    printf("%-32s %10zu fwd %10zu ovr %10zu B/tenant\n", "overlay heap", amount, overrides, overlay_heap / tenants);
+    printf("%-32s %10zu fwd %10zu ovr %10zu B/tenant\n", "full copy heap", amount, overrides, copy_heap);
+
+    if (copy != NULL && overlays[0] != NULL) {
+        size_t checksum = 0;
+        bool same = true;
+        bench_seed = 42;
+        double start = benchNow();
+        for (size_t i = 0; i < queries; i++) {
+            benchRandomNumber(num1, 12, 12);
+            PhoneNumbers *pnum = phfwdOverlayGet(overlays[0], num1);
+            checksum += phnumGet(pnum, 0)[1];
+            phnumDelete(pnum);
+        }
+        benchReport("phfwdOverlayGet", queries, benchNow() - start);
+
+        bench_seed = 42;
+        start = benchNow();
+        for (size_t i = 0; i < queries; i++) {
+            benchRandomNumber(num1, 12, 12);
+            PhoneNumbers *pnum = phfwdGet(copy, num1);
+            checksum -= phnumGet(pnum, 0)[1];
+            phnumDelete(pnum);
+        }
+        benchReport("phfwdGet full copy", queries, benchNow() - start);
+
+        // Poprawność sprawdzamy poza pomiarem, również dla przeciwobrazów.
+        bench_seed = 43;
+        for (size_t i = 0; i < 20; i++) {
+            benchRandomNumber(num1, 3, 6);
+            PhoneNumbers *a = phfwdOverlayReverse(overlays[0], num1);
+            PhoneNumbers *b = phfwdReverse(copy, num1);
+            PhoneNumbers *c = phfwdOverlayGetReverse(overlays[0], num1);
+            PhoneNumbers *d = phfwdGetReverse(copy, num1);
+            same = same && benchSameNumbers(a, b) && benchSameNumbers(c, d);
+            phnumDelete(a);
+            phnumDelete(b);
+            phnumDelete(c);
+            phnumDelete(d);
+        }
+        printf("%-32s %10s (checksum %zu)\n", "overlay matches copy", same ? "yes" : "NO", checksum);
+    }
+
+    phfwdDelete(copy);
+    for (size_t t = 0; t < tenants; t++) {
+        phfwdOverlayDelete(overlays[t]);
+    }
+    phfwdDelete(base);
+}
+
+/** @brief Mierzy czas równoległego wyznaczania przeciwobrazów dla różnej liczby wątków.
+ * Wszystkie przekierowania prowadzą na kilka krótkich numerów, więc każde zapytanie o numer zaczynający się od
+ * nich przegląda całą tablicę inwersji i zwraca dużą część przekierowanych numerów.
+ * @param amount - liczba przekierowań.
+ * @param queries - liczba zapytań dla każdej liczby wątków.
+ */
+static void benchParallel(size_t amount, size_t queries) {
+    static const char *targets[] = {"1", "12", "123", "2"};
+    static const char *nums[] = {"1234", "12345", "1299", "2"};
+    char num1[BENCH_MAX_LEN + 1], name[64];
+
+    PhoneForward *pf = phfwdNew();
+    if (pf == NULL) return;
+    bench_seed = 4321;
+    for (size_t i = 0; i < amount; i++) {
+        benchRandomNumber(num1, 6, 9);
+        phfwdAdd(pf, num1, targets[i % 4]);
+    }
+
+    double serial[2];
+    for (int get_reverse = 0; get_reverse < 2; get_reverse++) {
+        double start = benchNow();
+        for (size_t q = 0; q < queries; q++) {
+            const char *num = nums[q % 4];
+            phnumDelete(get_reverse ? phfwdGetReverse(pf, num) : phfwdReverse(pf, num));
+        }
+        serial[get_reverse] = benchNow() - start;
+        benchReport(get_reverse ? "phfwdGetReverse fan-in" : "phfwdReverse fan-in", queries, serial[get_reverse]);
+    }
+
+    for (size_t threads = 1; threads <= 8; threads *= 2) {
+        PhoneForwardThreadPool *pool = phfwdThreadPoolNew(threads);
+        if (pool == NULL) break;
+
+        for (int get_reverse = 0; get_reverse < 2; get_reverse++) {
+            double start = benchNow();
+            for (size_t q = 0; q < queries; q++) {
+                const char *num = nums[q % 4];
+                phnumDelete(get_reverse ? phfwdGetReverseParallel(pf, num, pool)
+                                        : phfwdReverseParallel(pf, num, pool));
+            }
+            double seconds = benchNow() - start;
+
+            // Wyniki porównujemy z wersją sekwencyjną poza mierzonym fragmentem.
+            bool same = true;
+            for (size_t q = 0; q < 4; q++) {
+                PhoneNumbers *pnum = get_reverse ? phfwdGetReverseParallel(pf, nums[q], pool)
+                                                 : phfwdReverseParallel(pf, nums[q], pool);
+                PhoneNumbers *expected = get_reverse ? phfwdGetReverse(pf, nums[q]) : phfwdReverse(pf, nums[q]);
+                same = same && benchSameNumbers(pnum, expected);
+                phnumDelete(pnum);
+                phnumDelete(expected);
+            }
+
+            snprintf(name, sizeof name, "%s x%zu", get_reverse ? "phfwdGetReverseParallel" : "phfwdReverseParallel",
+                     threads);
+            benchReport(name, queries, seconds);
+            printf("  speedup vs serial %.2fx%s\n", serial[get_reverse] / seconds, same ? "" : " RESULT MISMATCH");
+        }
+        phfwdThreadPoolDelete(pool);
+    }
+    phfwdDelete(pf);
+}
+
+/** @brief Mierzy pamięć odzyskiwaną przez przyrostowe porządkowanie po falach usunięć przekierowań.
+ * W każdej fali usuwana jest część przekierowań, po czym struktura jest porządkowana porcjami o podanym
+ * budżecie przeplatanymi z zapytaniami. Wypisywana jest zajęta pamięć, liczba porcji i najdłuższa porcja.
+ * Zmniejszanie tablic korzenia też jest dzielone na porcje, więc najdłuższa porcja nie zależy od rozmiaru puli numerów.
+ * @param amount - liczba przekierowań.
+ * @param queries - liczba zapytań wykonywanych pomiędzy porcjami porządkowania.
+ * @param budget - budżet jednej porcji porządkowania.
+ */
+static void benchCompact(size_t amount, size_t queries, size_t budget) {
+    static const char *names[] = {"compact malloc", "compact arena"};
+    char num1[BENCH_MAX_LEN + 1], num2[BENCH_MAX_LEN + 1], name[64];
+
+    for (int variant = 0; variant < 2; variant++) {
+        size_t heap_before = mallinfo2().uordblks;
+        PhoneForwardArena *arena = variant == 0 ? NULL : phfwdArenaNew(0, false);
+        PhoneForwardAllocator allocator = phfwdArenaAllocator(arena);
+        PhoneForward *pf = arena == NULL ? phfwdNew() : phfwdNewWithAllocator(&allocator);
+        PhoneForwardCompactor *pc = phfwdCompactorNew();
+        if (pf == NULL || pc == NULL) {
+            phfwdDelete(pf);
+            phfwdCompactorDelete(pc);
+            phfwdArenaDelete(arena);
+            continue;
+        }
+        bench_seed = 2468;
+        for (size_t i = 0; i < amount; i++) {
+            benchRandomNumber(num1, 6, 9);
+            benchRandomNumber(num2, 1, 6);
+            phfwdAdd(pf, num1, num2);
+        }
+        size_t used = arena != NULL ? phfwdArenaInUse(arena) : mallinfo2().uordblks - heap_before;
+        snprintf(name, sizeof name, "%s built", names[variant]);
+        printf("%-32s %10zu B\n", name, used);
+
+        // Każda fala usuwa co trzecie przekierowanie, odtwarzając numery z tego samego ziarna.
+        for (size_t wave = 0; wave < 3; wave++) {
+            bench_seed = 2468;
+            for (size_t i = 0; i < amount; i++) {
+                benchRandomNumber(num1, 6, 9);
+                benchRandomNumber(num2, 1, 6);
+                if (i % 3 == wave) phfwdRemove(pf, num1);
+            }
+            size_t removed = arena != NULL ? phfwdArenaInUse(arena) : mallinfo2().uordblks - heap_before;
+
+            size_t reclaimed = 0, slices = 0;
+            double longest = 0, total = 0;
+            bool finished = false;
+            while (!finished) {
+                double start = benchNow();
+                reclaimed += phfwdCompact(pf, pc, budget, &finished);
+                double seconds = benchNow() - start;
+                total += seconds;
+                if (seconds > longest) longest = seconds;
+                slices++;
+
+                for (size_t q = 0; q < queries; q++) {
+                    benchRandomNumber(num1, 6, 9);
+                    phnumDelete(phfwdGet(pf, num1));
+                }
+            }
+            size_t compacted = arena != NULL ? phfwdArenaInUse(arena) : mallinfo2().uordblks - heap_before;
+
+            snprintf(name, sizeof name, "%s wave %zu", names[variant], wave + 1);
+            printf("%-32s %10zu B removed %10zu B compacted %10zu B reclaimed\n", name, removed, compacted,
+                   reclaimed);
+            printf("%-32s %10zu slices %10.1f us max slice %10.1f ms total\n", "", slices, longest * 1e6,
+                   total * 1e3);
+        }
+
+        phfwdCompactorDelete(pc);
+        phfwdDelete(pf);
+        phfwdArenaDelete(arena);
+    }
+}
+
+/** @brief Mierzy pamięć zajmowaną przez strukturę i czas wyszukiwania dla wariantu zbioru cyfr, z którym zbudowano
+ * program. Porównanie obu wariantów wypisuje cel bench_alphabet.
+ * @param amount - liczba przekierowań.
+ * @param queries - liczba zapytań.
+ */
+static void benchAlphabet(size_t amount, size_t queries) {
+#ifdef PHONE_NUMBER_DIGITS_ONLY
+    const char *alphabet = "alphabet 0-9";
+#else
+    const char *alphabet = "alphabet 0-9*#";
+#endif
+    char num[BENCH_MAX_LEN + 1], name[64];
+
+    size_t heap_before = mallinfo2().uordblks;
+    double start = benchNow();
+    PhoneForward *pf = benchBuild(amount);
+    if (pf == NULL) return;
+    double seconds = benchNow() - start;
+    size_t heap = mallinfo2().uordblks - heap_before;
+    snprintf(name, sizeof name, "%s phfwdAdd", alphabet);
+    benchReport(name, amount, seconds);
+    snprintf(name, sizeof name, "%s heap", alphabet);
+    printf("%-32s %10zu B %10.1f B/fwd\n", name, heap, (double) heap / (double) amount);
+
+    size_t checksum = 0;
+    bench_seed = 42;
+    start = benchNow();
+    for (size_t i = 0; i < queries; i++) {
+        benchRandomNumber(num, 12, 12);
+        PhoneNumbers *pnum = phfwdGet(pf, num);
+        checksum += phnumGet(pnum, 0)[0];
+        phnumDelete(pnum);
+    }
+    seconds = benchNow() - start;
+    snprintf(name, sizeof name, "%s phfwdGet", alphabet);
+    benchReport(name, queries, seconds);
+    (void) checksum;
+
+    phfwdDelete(pf);
+}
+
+int main(int argc, char *argv[]) {
+    size_t amount = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+    size_t queries = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+    const char *only = argc > 3 ? argv[3] : NULL;
+
+    double start = benchNow();
+    PhoneForward *pf = benchBuild(amount);
+    if (pf == NULL) return 1;
+    benchReport("phfwdAdd", amount, benchNow() - start);
+
+    if (only == NULL || strcmp(only, "frozen") == 0) benchFrozen(pf, queries);
+    if (only == NULL || strcmp(only, "batch") == 0) benchBatch(pf, queries);
+    if (only == NULL || strcmp(only, "fanin") == 0) benchFanIn(amount, 8);
+    if (only == NULL || strcmp(only, "arena") == 0) benchArena(amount, queries);
+    if (only == NULL || strcmp(only, "relocate") == 0) benchRelocate(pf, queries);
+    if (only == NULL || strcmp(only, "overlay") == 0) benchOverlay(amount, queries, 2000);
+    // Każde zapytanie przegląda wszystkie przekierowania, więc wykonujemy ich znacznie mniej.
+    if (only == NULL || strcmp(only, "parallel") == 0) benchParallel(amount, queries / 10000 + 4);
+    if (only == NULL || strcmp(only, "compact") == 0) benchCompact(amount, 16, 4096);
+    if (only == NULL || strcmp(only, "alphabet") == 0) benchAlphabet(amount, queries);
+
+    phfwdDelete(pf);
+    return 0;
+}
@@ -142,6 +142,283 @@ int main() {
     assert(phnumGet(pnum, 1) == NULL);
     phnumDelete(pnum);
     phfwdDelete(pf);
+
+    PhoneForward *pf_old = phfwdNew();
+    PhoneForward *pf_new = phfwdNew();
+    const char *diff_num, *diff_old, *diff_new;
+    PhoneForwardDiff *diff;
+    assert(phfwdAdd(pf_old, "12", "7") == true);
+    assert(phfwdAdd(pf_old, "345", "8") == true);
+    assert(phfwdAdd(pf_old, "99", "1") == true);
+    assert(phfwdAdd(pf_new, "12", "7") == true);
+    assert(phfwdAdd(pf_new, "345", "9") == true);
+    assert(phfwdAdd(pf_new, "4", "1") == true);
+    assert(phfwdAdd(pf_new, "991", "2") == true);
+    phfwdRemove(pf_new, "99");
+
+    diff = phfwdDiffNew(pf_old, pf_new);
+    assert(phfwdDiffNext(diff, &diff_num, &diff_old, &diff_new) == true);
+    assert(strcmp(diff_num, "345") == 0 && strcmp(diff_old, "8") == 0 && strcmp(diff_new, "9") == 0);
+    assert(phfwdDiffNext(diff, &diff_num, &diff_old, &diff_new) == true);
+    assert(strcmp(diff_num, "4") == 0 && diff_old == NULL && strcmp(diff_new, "1") == 0);
+    assert(phfwdDiffNext(diff, &diff_num, &diff_old, &diff_new) == true);
+    assert(strcmp(diff_num, "99") == 0 && strcmp(diff_old, "1") == 0 && diff_new == NULL);
+    assert(phfwdDiffNext(diff, &diff_num, &diff_old, &diff_new) == false);
+    assert(phfwdDiffFailed(diff) == false);
+    assert(phfwdDiffFailed(NULL) == false);
+    phfwdDiffDelete(diff);
+
+    phfwdRemove(pf_new, "4");
+    phfwdRemove(pf_new, "345");
+    assert(phfwdAdd(pf_new, "345", "8") == true);
+    assert(phfwdAdd(pf_new, "99", "1") == true);
+    diff = phfwdDiffNew(pf_old, pf_new);
+    assert(phfwdDiffNext(diff, &diff_num, &diff_old, &diff_new) == false);
+    phfwdDiffDelete(diff);
+    phfwdDelete(pf_old);
+    phfwdDelete(pf_new);
+
+    pf = phfwdNew();
+    assert(phfwdAdd(pf, "123", "9") == true);
+    assert(phfwdAdd(pf, "123456", "777777") == true);
+    assert(phfwdAdd(pf, "2", "9") == true);
+#ifdef PHONE_NUMBER_DIGITS_ONLY
+    assert(phfwdAdd(pf, "*#", "9") == false);
+    assert(phfwdAdd(pf, "3", "9") == true);
+#else
+    assert(phfwdAdd(pf, "*#", "9") == true);
+#endif
+    PhoneForwardFrozen *pff = phfwdFreeze(pf);
+    assert(phfwdFrozenGetInto(pff, "12345", num1, sizeof num1) == 3);
+    assert(strcmp(num1, "945") == 0);
+    pnum = phfwdFrozenGet(pff, "1234567");
+    assert(strcmp(phnumGet(pnum, 0), "7777777") == 0);
+    assert(phnumGet(pnum, 1) == NULL);
+    phnumDelete(pnum);
+    pnum = phfwdFrozenGet(pff, "12");
+    assert(strcmp(phnumGet(pnum, 0), "12") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdFrozenGet(pff, "A");
+    assert(phnumGet(pnum, 0) == NULL);
+    phnumDelete(pnum);
+    pnum = phfwdFrozenReverse(pff, "91");
+    assert(strcmp(phnumGet(pnum, 0), "1231") == 0);
+    assert(strcmp(phnumGet(pnum, 1), "21") == 0);
+#ifdef PHONE_NUMBER_DIGITS_ONLY
+    assert(strcmp(phnumGet(pnum, 2), "31") == 0);
+    assert(strcmp(phnumGet(pnum, 3), "91") == 0);
+#else
+    assert(strcmp(phnumGet(pnum, 2), "91") == 0);
+    assert(strcmp(phnumGet(pnum, 3), "*#1") == 0);
+#endif
+    assert(phnumGet(pnum, 4) == NULL);
+    phnumDelete(pnum);
+    phfwdFrozenDelete(pff);
+    phfwdDelete(pf);
+
+    pf = phfwdNew();
+    assert(phfwdAdd(pf, "5", "1") == true);
+    assert(phfwdAdd(pf, "3", "1") == true);
+    assert(phfwdAdd(pf, "4", "1") == true);
+    assert(phfwdAdd(pf, "5", "2") == true);
+    pnum = phfwdReverse(pf, "17");
+    assert(strcmp(phnumGet(pnum, 0), "17") == 0);
+    assert(strcmp(phnumGet(pnum, 1), "37") == 0);
+    assert(strcmp(phnumGet(pnum, 2), "47") == 0);
+    assert(phnumGet(pnum, 3) == NULL);
+    phnumDelete(pnum);
+    phfwdRemove(pf, "3");
+    pnum = phfwdReverse(pf, "17");
+    assert(strcmp(phnumGet(pnum, 0), "17") == 0);
+    assert(strcmp(phnumGet(pnum, 1), "47") == 0);
+    assert(phnumGet(pnum, 2) == NULL);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "57");
+    assert(strcmp(phnumGet(pnum, 0), "27") == 0);
+    phnumDelete(pnum);
+
+    const char *batch_nums[] = {"57", "A", "17", "4", "5"};
+    PhoneNumbers *batch_res[5];
+    assert(phfwdGetBatch(pf, batch_nums, 5, batch_res) == true);
+    assert(strcmp(phnumGet(batch_res[0], 0), "27") == 0);
+    assert(phnumGet(batch_res[1], 0) == NULL);
+    assert(strcmp(phnumGet(batch_res[2], 0), "17") == 0);
+    assert(strcmp(phnumGet(batch_res[3], 0), "1") == 0);
+    assert(strcmp(phnumGet(batch_res[4], 0), "2") == 0);
+    for (int i = 0; i < 5; i++) {
+        phnumDelete(batch_res[i]);
+    }
+    phfwdDelete(pf);
+
+    PhoneForwardArena *arena = phfwdArenaNew(4 << 20, false);
+    PhoneForwardAllocator allocator = phfwdArenaAllocator(arena);
+    pf = phfwdNewWithAllocator(&allocator);
+    assert(pf != NULL);
+    assert(phfwdAdd(pf, "123", "9") == true);
+    bool exhausted = false;
+    for (int i = 0; i < 1000000 && !exhausted; i++) {
+        snprintf(num1, sizeof num1, "4%d", i);
+        snprintf(num2, sizeof num2, "5%d", i);
+        exhausted = !phfwdAdd(pf, num1, num2);
+    }
+    assert(exhausted == true);
+    assert(phfwdArenaMapped(arena) <= 4 << 20);
+    pnum = phfwdGet(pf, "1234");
+    assert(strcmp(phnumGet(pnum, 0), "94") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "4107");
+    assert(strcmp(phnumGet(pnum, 0), "5107") == 0);
+    phnumDelete(pnum);
+    phfwdRemove(pf, "4");
+    assert(phfwdAdd(pf, "41", "6") == true);
+    phfwdDelete(pf);
+    assert(phfwdArenaInUse(arena) == 0);
+    phfwdArenaDelete(arena);
+
+    pf = phfwdNew();
+    for (int i = 0; i < 10000; i++) {
+        snprintf(num1, sizeof num1, "%d", 7 * i);
+        assert(phfwdAdd(pf, num1, i % 3 == 0 ? "1" : "12") == true);
+    }
+    PhoneForwardThreadPool *pool = phfwdThreadPoolNew(3);
+    assert(pool != NULL);
+    for (int get_reverse = 0; get_reverse < 2; get_reverse++) {
+        pnum = get_reverse ? phfwdGetReverse(pf, "1234") : phfwdReverse(pf, "1234");
+        PhoneNumbers *parallel = get_reverse ? phfwdGetReverseParallel(pf, "1234", pool)
+                                             : phfwdReverseParallel(pf, "1234", pool);
+        size_t idx = 0;
+        for (; phnumGet(pnum, idx) != NULL; idx++) {
+            assert(strcmp(phnumGet(pnum, idx), phnumGet(parallel, idx)) == 0);
+        }
+        assert(idx > 4096);
+        assert(phnumGet(parallel, idx) == NULL);
+        phnumDelete(pnum);
+        phnumDelete(parallel);
+    }
+    pnum = phfwdReverseParallel(pf, "12a", pool);
+    assert(phnumGet(pnum, 0) == NULL);
+    phnumDelete(pnum);
+    phfwdThreadPoolDelete(pool);
+
+    assert(phfwdRelocate(pf, 100) == 0);
+    phfwdProfile(pf, true);
+    for (int i = 0; i < 50; i++) {
+        pnum = phfwdGet(pf, i % 2 == 0 ? "7000" : "14994");
+        phnumDelete(pnum);
+    }
+    phfwdProfile(pf, false);
+    assert(phfwdRelocate(pf, 100) == 9);
+    pnum = phfwdGet(pf, "70001");
+    assert(strcmp(phnumGet(pnum, 0), "121") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "149945");
+    assert(strcmp(phnumGet(pnum, 0), "15") == 0);
+    phnumDelete(pnum);
+    phfwdRemove(pf, "700");
+    pnum = phfwdGet(pf, "70001");
+    assert(strcmp(phnumGet(pnum, 0), "12001") == 0);
+    phnumDelete(pnum);
+    assert(phfwdAdd(pf, "7000", "3") == true);
+    assert(phfwdRelocate(pf, 3) == 3);
+    pnum = phfwdGet(pf, "70001");
+    assert(strcmp(phnumGet(pnum, 0), "31") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "149945");
+    assert(strcmp(phnumGet(pnum, 0), "15") == 0);
+    phnumDelete(pnum);
+    phfwdDelete(pf);
+
+    pf = phfwdNew();
+    assert(phfwdAdd(pf, "7000", "3") == true);
+    assert(phfwdAdd(pf, "1499", "15") == true);
+    phfwdProfile(pf, true);
+    const char *profile_nums[] = {"70001", "149945"};
+    PhoneNumbers *profile_res[2];
+    assert(phfwdGetBatch(pf, profile_nums, 2, profile_res) == true);
+    phnumDelete(profile_res[0]);
+    phnumDelete(profile_res[1]);
+    phfwdProfile(pf, false);
+    assert(phfwdRelocate(pf, 100) == 8);
+    phfwdDelete(pf);
+
+    pf = phfwdNew();
+    assert(phfwdAdd(pf, "12", "7") == true);
+    assert(phfwdAdd(pf, "123", "8") == true);
+    assert(phfwdAdd(pf, "5", "7") == true);
+    PhoneForwardOverlay *ov = phfwdOverlayNew(pf);
+    assert(ov != NULL);
+    assert(phfwdOverlayRemove(ov, "12") == true);
+    assert(phfwdOverlayAdd(ov, "1234", "9") == true);
+    pnum = phfwdOverlayGet(ov, "12345");
+    assert(strcmp(phnumGet(pnum, 0), "95") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdOverlayGet(ov, "1239");
+    assert(strcmp(phnumGet(pnum, 0), "1239") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "1239");
+    assert(strcmp(phnumGet(pnum, 0), "89") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdOverlayReverse(ov, "71");
+    assert(strcmp(phnumGet(pnum, 0), "51") == 0);
+    assert(strcmp(phnumGet(pnum, 1), "71") == 0);
+    assert(phnumGet(pnum, 2) == NULL);
+    phnumDelete(pnum);
+    pnum = phfwdOverlayGetReverse(ov, "95");
+    assert(strcmp(phnumGet(pnum, 0), "12345") == 0);
+    assert(strcmp(phnumGet(pnum, 1), "95") == 0);
+    assert(phnumGet(pnum, 2) == NULL);
+    phnumDelete(pnum);
+    assert(phfwdOverlayRemove(ov, "1") == true);
+    pnum = phfwdOverlayGet(ov, "12345");
+    assert(strcmp(phnumGet(pnum, 0), "12345") == 0);
+    phnumDelete(pnum);
+    phfwdOverlayDelete(ov);
+    phfwdDelete(pf);
+
+    pf = phfwdNew();
+    for (int i = 0; i < 1000; i++) {
+        snprintf(num1, sizeof num1, "1%03d", i);
+        assert(phfwdAdd(pf, num1, "2") == true);
+    }
+    for (int i = 0; i < 1000; i++) {
+        if (i % 100 == 7) continue;
+        snprintf(num1, sizeof num1, "1%03d", i);
+        phfwdRemove(pf, num1);
+    }
+    assert(phfwdCompact(NULL, NULL, 1, NULL) == 0);
+    PhoneForwardCompactor *pc = phfwdCompactorNew();
+    assert(pc != NULL);
+    size_t reclaimed = 0;
+    bool finished = false;
+    int slices = 0;
+    while (!finished) {
+        reclaimed += phfwdCompact(pf, pc, 8, &finished);
+        slices++;
+        // Zmiany pomiędzy wywołaniami nie przeszkadzają w porządkowaniu.
+        if (slices == 3) assert(phfwdAdd(pf, "19999", "3") == true);
+        if (slices == 5) phfwdRemove(pf, "10");
+    }
+    assert(slices > 3);
+    assert(reclaimed > 0);
+    assert(phfwdCompact(pf, NULL, 1, &finished) == 0);
+    assert(finished == true);
+    pnum = phfwdGet(pf, "15075");
+    assert(strcmp(phnumGet(pnum, 0), "25") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "1999");
+    assert(strcmp(phnumGet(pnum, 0), "1999") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "199995");
+    assert(strcmp(phnumGet(pnum, 0), "35") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdGet(pf, "10075");
+    assert(strcmp(phnumGet(pnum, 0), "10075") == 0);
+    phnumDelete(pnum);
+    pnum = phfwdReverse(pf, "2");
+    assert(strcmp(phnumGet(pnum, 0), "1107") == 0);
+    phnumDelete(pnum);
+    phfwdCompactorDelete(pc);
+    phfwdDelete(pf);
     printf("Zakonczono");
     return 0;
 }
@@ -0,0 +1,186 @@
+/** @file
+ * Implementacja biblioteki klienta serwera przekierowań numerów telefonicznych
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "phone_forward_ipc.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(PhoneForwardRequestHeader) == PHIPC_REQUEST_HEADER_SIZE, "request header size");
+_Static_assert(sizeof(PhoneForwardResponseHeader) == PHIPC_RESPONSE_HEADER_SIZE, "response header size");
+
+/** @brief Rozmiar bufora żądań, po przekroczeniu którego żądania są wysyłane.
+ */
+#define PHIPC_SEND_THRESHOLD 65536
+
+/** @brief Struktura połączenia klienta z serwerem przekierowań.
+ */
+struct PhoneForwardClient {
+    //! Deskryptor gniazda.
+    int fd;
+    //! Bufor żądań oczekujących na wysłanie.
+    char *out;
+    //! Liczba bajtów w buforze żądań.
+    size_t out_size;
+    //! Pojemność bufora żądań.
+    size_t out_capacity;
+    //! Bufor odebranych danych.
+    char *in;
+    //! Początek nieprzetworzonych danych w buforze odebranych danych.
+    size_t in_begin;
+    //! Koniec odebranych danych.
+    size_t in_size;
+    //! Pojemność bufora odebranych danych.
+    size_t in_capacity;
+    //! Rozmiar ostatnio udostępnionej odpowiedzi, zwalnianej przy kolejnym odbiorze.
+    size_t in_pending;
+};
+
+/** @brief Zapewnia, że bufor pomieści @p size bajtów.
+ * @param buf - wskaźnik na wskaźnik na bufor.
+ * @param capacity - wskaźnik na pojemność bufora.
+ * @param size - wymagany rozmiar.
+ * @return Wartość @p true, jeśli bufor ma wystarczającą pojemność, lub @p false, gdy nie udało się alokować pamięci.
+ */
+static bool phipcReserve(char **buf, size_t *capacity, size_t size) {
+    if (size <= *capacity) return true;
+
+    size_t new_capacity = *capacity;
+    while (new_capacity < size) new_capacity *= 2;
+    char *new_buf = realloc(*buf, new_capacity);
+    if (new_buf == NULL) return false;
+    *buf = new_buf;
+    *capacity = new_capacity;
+    return true;
+}
+
+PhoneForwardClient *phipcConnect(char const *path) {
+    if (path == NULL || strlen(path) >= sizeof(((struct sockaddr_un *) NULL)->sun_path)) return NULL;
+
+    PhoneForwardClient *client = malloc(sizeof(PhoneForwardClient));
+    if (client == NULL) return NULL;
+
+    client->out_size = 0;
+    client->out_capacity = 4096;
+    client->out = malloc(client->out_capacity);
+    client->in_begin = 0;
+    client->in_size = 0;
+    client->in_pending = 0;
+    client->in_capacity = 4096;
+    client->in = malloc(client->in_capacity);
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->out == NULL || client->in == NULL || client->fd < 0) {
+        phipcClose(client);
+        return NULL;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(client->fd, (struct sockaddr *) &addr, sizeof addr) != 0) {
+        phipcClose(client);
+        return NULL;
+    }
+    return client;
+}
+
+void phipcClose(PhoneForwardClient *client) {
+    if (client == NULL) return;
+
+    if (client->fd >= 0) close(client->fd);
+    free(client->out);
+    free(client->in);
+    free(client);
+}
+
+bool phipcSend(PhoneForwardClient *client, uint32_t id, uint8_t op, char const *num) {
+    if (client == NULL || num == NULL) return false;
+
+    size_t len = strlen(num);
+    if (len > PHIPC_MAX_NUMBER_LENGTH) return false;
+    if (!phipcReserve(&client->out, &client->out_capacity, client->out_size + PHIPC_REQUEST_HEADER_SIZE + len)) {
+        return false;
+    }
+
+    PhoneForwardRequestHeader header = {id, op, 0, (uint16_t) len};
+    memcpy(client->out + client->out_size, &header, PHIPC_REQUEST_HEADER_SIZE);
+    memcpy(client->out + client->out_size + PHIPC_REQUEST_HEADER_SIZE, num, len);
+    client->out_size += PHIPC_REQUEST_HEADER_SIZE + len;
+
+    if (client->out_size >= PHIPC_SEND_THRESHOLD) return phipcFlush(client);
+    return true;
+}
+
+bool phipcFlush(PhoneForwardClient *client) {
+    if (client == NULL) return false;
+
+    size_t sent = 0;
+    while (sent < client->out_size) {
+        ssize_t res = send(client->fd, client->out + sent, client->out_size - sent, MSG_NOSIGNAL);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += (size_t) res;
+    }
+    client->out_size = 0;
+    return true;
+}
+
+bool phipcReceive(PhoneForwardClient *client, PhoneForwardResponse *response) {
+    if (client == NULL || response == NULL || !phipcFlush(client)) return false;
+
+    client->in_begin += client->in_pending;
+    client->in_pending = 0;
+    if (client->in_begin == client->in_size) {
+        client->in_begin = 0;
+        client->in_size = 0;
+    }
+
+    size_t need = PHIPC_RESPONSE_HEADER_SIZE;
+    while (true) {
+        size_t available = client->in_size - client->in_begin;
+        if (available >= PHIPC_RESPONSE_HEADER_SIZE) {
+            memcpy(&response->header, client->in + client->in_begin, PHIPC_RESPONSE_HEADER_SIZE);
+            need = PHIPC_RESPONSE_HEADER_SIZE + (size_t) response->header.length;
+            if (available >= need) break;
+        }
+
+        // Przesuwamy nieprzetworzone dane na początek bufora, żeby zmieścić całą odpowiedź.
+        if (client->in_begin > 0) {
+            memmove(client->in, client->in + client->in_begin, available);
+            client->in_begin = 0;
+            client->in_size = available;
+        }
+        if (!phipcReserve(&client->in, &client->in_capacity, need)) return false;
+
+        ssize_t res = recv(client->fd, client->in + client->in_size, client->in_capacity - client->in_size, 0);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+        client->in_size += (size_t) res;
+    }
+
+    response->numbers = client->in + client->in_begin + PHIPC_RESPONSE_HEADER_SIZE;
+    client->in_pending = need;
+    return true;
+}
+
+char const *phipcResponseGet(PhoneForwardResponse const *response, size_t idx) {
+    if (response == NULL || idx >= response->header.count) return NULL;
+
+    const char *num = response->numbers;
+    for (size_t i = 0; i < idx; i++) {
+        num += strlen(num) + 1;
+    }
+    return num;
+}
@@ -0,0 +1,135 @@
+/** @file
+ * Interfejs protokołu i biblioteki klienta serwera przekierowań numerów telefonicznych
+ *
+ * Serwer nasłuchuje na gnieździe domeny uniksowej. Klient może wysłać wiele żądań bez czekania na odpowiedzi,
+ * a serwer odpowiada na żądania z jednego połączenia w kolejności ich otrzymania. Pola nagłówków są zapisywane
+ * w kolejności bajtów komputera, ponieważ klient i serwer działają na tej samej maszynie.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#ifndef __PHONE_FORWARD_IPC_H__
+#define __PHONE_FORWARD_IPC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Operacja @ref phfwdGet. */
+#define PHIPC_OP_GET 1
+/** @brief Operacja @ref phfwdReverse. */
+#define PHIPC_OP_REVERSE 2
+/** @brief Operacja @ref phfwdGetReverse. */
+#define PHIPC_OP_GET_REVERSE 3
+
+/** @brief Żądanie zostało wykonane. */
+#define PHIPC_STATUS_OK 0
+/** @brief Żądanie zawierało nieznaną operację. */
+#define PHIPC_STATUS_BAD_REQUEST 1
+/** @brief Serwerowi nie udało się alokować pamięci. */
+#define PHIPC_STATUS_NO_MEMORY 2
+
+/** @brief Rozmiar nagłówka żądania w bajtach. */
+#define PHIPC_REQUEST_HEADER_SIZE 8
+/** @brief Rozmiar nagłówka odpowiedzi w bajtach. */
+#define PHIPC_RESPONSE_HEADER_SIZE 16
+/** @brief Maksymalna długość numeru w żądaniu. */
+#define PHIPC_MAX_NUMBER_LENGTH UINT16_MAX
+
+/** @brief Nagłówek żądania, po którym następuje @p length bajtów numeru bez kończącego znaku '\\0'.
+ */
+typedef struct PhoneForwardRequestHeader {
+    //! Identyfikator żądania, powtarzany w odpowiedzi.
+    uint32_t id;
+    //! Operacja, jedna ze stałych PHIPC_OP_*.
+    uint8_t op;
+    //! Zarezerwowane, równe 0.
+    uint8_t reserved;
+    //! Długość numeru.
+    uint16_t length;
+} PhoneForwardRequestHeader;
+
+/** @brief Nagłówek odpowiedzi, po którym następuje @p length bajtów zawierających @p count numerów, każdy
+ * zakończony znakiem '\\0'.
+ */
+typedef struct PhoneForwardResponseHeader {
+    //! Identyfikator żądania.
+    uint32_t id;
+    //! Wynik wykonania żądania, jedna ze stałych PHIPC_STATUS_*.
+    uint8_t status;
+    //! Operacja z żądania.
+    uint8_t op;
+    //! Zarezerwowane, równe 0.
+    uint16_t reserved;
+    //! Liczba numerów.
+    uint32_t count;
+    //! Łączna długość numerów.
+    uint32_t length;
+} PhoneForwardResponseHeader;
+
+/** @brief To jest struktura połączenia klienta z serwerem przekierowań.
+ *
+ */
+struct PhoneForwardClient;
+typedef struct PhoneForwardClient PhoneForwardClient;
+
+/** @brief Odpowiedź serwera udostępniona przez @ref phipcReceive.
+ */
+typedef struct PhoneForwardResponse {
+    //! Nagłówek odpowiedzi.
+    PhoneForwardResponseHeader header;
+    //! Wskaźnik na numery, ważny do kolejnego wywołania @ref phipcReceive lub @ref phipcClose.
+    const char *numbers;
+} PhoneForwardResponse;
+
+/** @brief Łączy się z serwerem.
+ * @param[in] path – ścieżka gniazda serwera.
+ * @return Wskaźnik na połączenie lub NULL, gdy nie udało się połączyć lub
+ *         alokować pamięci.
+ */
+PhoneForwardClient *phipcConnect(char const *path);
+
+/** @brief Zamyka połączenie.
+ * Nic nie robi, jeśli wskaźnik @p client ma wartość NULL.
+ * @param[in] client – wskaźnik na zamykane połączenie.
+ */
+void phipcClose(PhoneForwardClient *client);
+
+/** @brief Dodaje żądanie do bufora wysyłanych żądań.
+ * Żądania są wysyłane, gdy bufor się zapełni, oraz przy wywołaniu @ref phipcFlush lub @ref phipcReceive.
+ * @param[in,out] client – wskaźnik na połączenie;
+ * @param[in] id         – identyfikator żądania;
+ * @param[in] op         – operacja, jedna ze stałych PHIPC_OP_*;
+ * @param[in] num        – wskaźnik na napis reprezentujący numer.
+ * @return Wartość @p true, jeśli żądanie zostało dodane.
+ *         Wartość @p false, jeśli numer jest za długi, nie udało się alokować
+ *         pamięci lub wysłać danych.
+ */
+bool phipcSend(PhoneForwardClient *client, uint32_t id, uint8_t op, char const *num);
+
+/** @brief Wysyła wszystkie żądania z bufora.
+ * @param[in,out] client – wskaźnik na połączenie.
+ * @return Wartość @p true, jeśli dane zostały wysłane, lub @p false w przeciwnym wypadku.
+ */
+bool phipcFlush(PhoneForwardClient *client);
+
+/** @brief Odbiera kolejną odpowiedź.
+ * Najpierw wysyła żądania pozostałe w buforze, a następnie czeka na odpowiedź.
+ * @param[in,out] client – wskaźnik na połączenie;
+ * @param[out] response  – wskaźnik na odebraną odpowiedź.
+ * @return Wartość @p true, jeśli odebrano odpowiedź.
+ *         Wartość @p false, jeśli połączenie zostało zamknięte lub wystąpił błąd.
+ */
+bool phipcReceive(PhoneForwardClient *client, PhoneForwardResponse *response);
+
+/** @brief Udostępnia numer z odpowiedzi.
+ * Numery są indeksowane kolejno od zera. Koszt jest liniowy względem @p idx, więc przy przeglądaniu wszystkich
+ * numerów lepiej przechodzić kolejne napisy bezpośrednio.
+ * @param[in] response – wskaźnik na odpowiedź;
+ * @param[in] idx      – indeks numeru.
+ * @return Wskaźnik na numer lub NULL, jeśli indeks ma za dużą wartość.
+ */
+char const *phipcResponseGet(PhoneForwardResponse const *response, size_t idx);
+
+#endif /* __PHONE_FORWARD_IPC_H__ */
@@ -0,0 +1,188 @@
+/** @file
+ * Generator obciążenia serwera przekierowań numerów telefonicznych
+ *
+ * Użycie: phone_forward_loadgen ścieżka_gniazda [połączenia] [głębokość_potoku] [żądania_na_połączenie] [operacja]
+ *
+ * Każde połączenie jest obsługiwane przez osobny wątek, który utrzymuje stałą liczbę żądań oczekujących na
+ * odpowiedź. Po zakończeniu wypisywana jest przepustowość oraz percentyle czasu odpowiedzi. Operacja to jedno
+ * z: get, reverse, getreverse.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "phone_forward_ipc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Struktura wątku generatora.
+ */
+typedef struct LoadThread {
+    //! Wątek.
+    pthread_t thread;
+    //! Ziarno generatora liczb pseudolosowych.
+    uint64_t seed;
+    //! Liczba wysyłanych żądań.
+    size_t requests;
+    //! Liczba żądań oczekujących na odpowiedź.
+    size_t depth;
+    //! Operacja, jedna ze stałych PHIPC_OP_*.
+    uint8_t op;
+    //! Czasy odpowiedzi na kolejne żądania w nanosekundach.
+    uint64_t *latencies;
+    //! Liczba odebranych odpowiedzi.
+    size_t completed;
+    //! Liczba odpowiedzi ze statusem innym niż PHIPC_STATUS_OK.
+    size_t errors;
+} LoadThread;
+
+/** @brief Ścieżka gniazda serwera.
+ */
+static const char *load_path;
+
+/** @brief Zwraca aktualny czas w nanosekundach.
+ * @return Czas w nanosekundach.
+ */
+static uint64_t loadNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/** @brief Zapisuje do @p num losowy dziewięciocyfrowy numer.
+ * @param seed - wskaźnik na stan generatora liczb pseudolosowych.
+ * @param num - wskaźnik na bufor o rozmiarze co najmniej 10.
+ */
+static void loadRandomNumber(uint64_t *seed, char *num) {
+    for (int i = 0; i < 9; i++) {
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+        num[i] = (char) ('0' + *seed % 10);
+    }
+    num[9] = '\0';
+}
+
+/** @brief Wysyła żądania jednym połączeniem, utrzymując @p depth żądań w locie.
+ * @param arg - wskaźnik na wątek generatora.
+ * @return NULL.
+ */
+static void *loadRun(void *arg) {
+    LoadThread *lt = arg;
+    char num[10];
+    PhoneForwardResponse response;
+
+    PhoneForwardClient *client = phipcConnect(load_path);
+    uint64_t *sent_at = malloc(lt->depth * sizeof(uint64_t));
+    if (client == NULL || sent_at == NULL) {
+        phipcClose(client);
+        free(sent_at);
+        return NULL;
+    }
+
+    size_t sent = 0;
+    for (; sent < lt->depth && sent < lt->requests; sent++) {
+        loadRandomNumber(&lt->seed, num);
+        sent_at[sent % lt->depth] = loadNow();
+        if (!phipcSend(client, (uint32_t) sent, lt->op, num)) break;
+    }
+
+    while (lt->completed < sent && phipcReceive(client, &response)) {
+        uint64_t now = loadNow();
+        lt->latencies[lt->completed] = now - sent_at[response.header.id % lt->depth];
+        if (response.header.status != PHIPC_STATUS_OK) lt->errors++;
+        lt->completed++;
+
+        if (sent < lt->requests) {
+            loadRandomNumber(&lt->seed, num);
+            sent_at[sent % lt->depth] = loadNow();
+            if (phipcSend(client, (uint32_t) sent, lt->op, num)) sent++;
+        }
+    }
+
+    free(sent_at);
+    phipcClose(client);
+    return NULL;
+}
+
+/** @brief Komparator czasów odpowiedzi.
+ * @param a - wskaźnik na pierwszy czas.
+ * @param b - wskaźnik na drugi czas.
+ * @return Zmienna typu int o wartości zgodnej z działaniem komparatorów.
+ */
+static int loadCmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s socket_path [connections] [depth] [requests] [get|reverse|getreverse]\n", argv[0]);
+        return 1;
+    }
+    load_path = argv[1];
+    size_t connections = argc > 2 ? strtoull(argv[2], NULL, 10) : 4;
+    size_t depth = argc > 3 ? strtoull(argv[3], NULL, 10) : 16;
+    size_t requests = argc > 4 ? strtoull(argv[4], NULL, 10) : 100000;
+    uint8_t op = PHIPC_OP_GET;
+    if (argc > 5 && strcmp(argv[5], "reverse") == 0) op = PHIPC_OP_REVERSE;
+    if (argc > 5 && strcmp(argv[5], "getreverse") == 0) op = PHIPC_OP_GET_REVERSE;
+    if (connections == 0 || depth == 0 || requests == 0) return 1;
+
+    LoadThread *threads = calloc(connections, sizeof(LoadThread));
+    uint64_t *latencies = malloc(connections * requests * sizeof(uint64_t));
+    if (threads == NULL || latencies == NULL) {
+        free(threads);
+        free(latencies);
+        return 1;
+    }
+
+    uint64_t start = loadNow();
+    size_t started = 0;
+    for (; started < connections; started++) {
+        LoadThread *lt = &threads[started];
+        lt->seed = 0x9e3779b97f4a7c15ULL * (started + 1);
+        lt->requests = requests;
+        lt->depth = depth;
+        lt->op = op;
+        lt->latencies = latencies + started * requests;
+        if (pthread_create(&lt->thread, NULL, loadRun, lt) != 0) break;
+    }
+
+    size_t completed = 0, errors = 0;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+        // Przesuwamy wyniki do spójnego fragmentu tablicy, żeby posortować je razem.
+        memmove(latencies + completed, threads[i].latencies, threads[i].completed * sizeof(uint64_t));
+        completed += threads[i].completed;
+        errors += threads[i].errors;
+    }
+    double seconds = (double) (loadNow() - start) * 1e-9;
+
+    if (completed == 0) {
+        fprintf(stderr, "no responses received\n");
+        free(threads);
+        free(latencies);
+        return 1;
+    }
+
+    qsort(latencies, completed, sizeof(uint64_t), loadCmp);
+    printf("connections %zu depth %zu requests %zu errors %zu\n", started, depth, completed, errors);
+    printf("throughput %.0f req/s\n", (double) completed / seconds);
+    printf("latency us p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+           (double) latencies[completed / 2] * 1e-3,
+           (double) latencies[completed * 9 / 10] * 1e-3,
+           (double) latencies[completed * 99 / 100] * 1e-3,
+           (double) latencies[completed * 999 / 1000] * 1e-3,
+           (double) latencies[completed - 1] * 1e-3);
+
+    free(threads);
+    free(latencies);
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,436 @@
+/** @file
+ * Serwer udostępniający jedną strukturę przekierowań numerów telefonicznych przez gniazdo domeny uniksowej
+ *
+ * Użycie: phone_forward_server ścieżka_gniazda [plik_przekierowań] [liczba_wątków]
+ *
+ * Plik przekierowań zawiera w każdym wierszu dwa numery oddzielone białym znakiem, które są przekazywane do
+ * @ref phfwdAdd. Każdy wątek roboczy obsługuje własną pętlę epoll. Gniazdo nasłuchujące jest zarejestrowane we
+ * wszystkich pętlach z flagą EPOLLEXCLUSIVE, więc nowe połączenie budzi jeden wątek, który od tej chwili obsługuje
+ * je w całości. Dzięki temu żądania z jednego połączenia są wykonywane po kolei bez dodatkowej synchronizacji,
+ * a struktura przekierowań jest tylko czytana.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#define _GNU_SOURCE
+
+#include "phone_forward.h"
+#include "phone_forward_ipc.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** @brief Liczba bajtów odpowiedzi oczekujących na wysłanie, po przekroczeniu której serwer przestaje czytać
+ * kolejne żądania z połączenia.
+ */
+#define SERVER_OUTPUT_LIMIT (1 << 20)
+
+/** @brief Maksymalna liczba zdarzeń odbieranych jednym wywołaniem epoll_wait.
+ */
+#define SERVER_MAX_EVENTS 64
+
+/** @brief Struktura połączenia z klientem.
+ */
+typedef struct Connection {
+    //! Deskryptor gniazda.
+    int fd;
+    //! Zdarzenia, na które połączenie jest aktualnie zarejestrowane w epoll.
+    uint32_t events;
+    //! Bufor odebranych danych.
+    char *in;
+    //! Liczba bajtów w buforze odebranych danych.
+    size_t in_size;
+    //! Pojemność bufora odebranych danych.
+    size_t in_capacity;
+    //! Bufor odpowiedzi.
+    char *out;
+    //! Początek niewysłanych danych w buforze odpowiedzi.
+    size_t out_begin;
+    //! Koniec danych w buforze odpowiedzi.
+    size_t out_size;
+    //! Pojemność bufora odpowiedzi.
+    size_t out_capacity;
+    //! Czy klient zakończył wysyłanie żądań. Połączenie jest wtedy zamykane po wysłaniu wszystkich odpowiedzi.
+    bool eof;
+    //! Poprzednie połączenie na liście połączeń wątku.
+    struct Connection *prev;
+    //! Następne połączenie na liście połączeń wątku.
+    struct Connection *next;
+} Connection;
+
+/** @brief Struktura wątku roboczego.
+ */
+typedef struct Worker {
+    //! Wątek.
+    pthread_t thread;
+    //! Deskryptor pętli epoll wątku.
+    int epoll_fd;
+    //! Lista połączeń obsługiwanych przez wątek.
+    Connection *connections;
+} Worker;
+
+/** @brief Ustawiana przez obsługę sygnałów, kończy pracę serwera.
+ */
+static volatile sig_atomic_t server_stop = 0;
+
+/** @brief Udostępniana struktura przekierowań.
+ */
+static PhoneForward *server_table;
+
+/** @brief Deskryptor gniazda nasłuchującego.
+ */
+static int server_listen_fd;
+
+/** @brief Obsługuje sygnały kończące pracę serwera.
+ * @param sig - numer sygnału.
+ */
+static void serverSignal(int sig) {
+    (void) sig;
+    server_stop = 1;
+}
+
+/** @brief Zapewnia, że bufor pomieści @p size bajtów.
+ * @param buf - wskaźnik na wskaźnik na bufor.
+ * @param capacity - wskaźnik na pojemność bufora.
+ * @param size - wymagany rozmiar.
+ * @return Wartość @p true, jeśli bufor ma wystarczającą pojemność, lub @p false, gdy nie udało się alokować pamięci.
+ */
+static bool serverReserve(char **buf, size_t *capacity, size_t size) {
+    if (size <= *capacity) return true;
+
+    size_t new_capacity = *capacity;
+    while (new_capacity < size) new_capacity *= 2;
+    char *new_buf = realloc(*buf, new_capacity);
+    if (new_buf == NULL) return false;
+    *buf = new_buf;
+    *capacity = new_capacity;
+    return true;
+}
+
+/** @brief Zamyka połączenie i usuwa je z listy połączeń wątku.
+ * @param worker - wskaźnik na wątek.
+ * @param conn - wskaźnik na zamykane połączenie.
+ */
+static void connectionClose(Worker *worker, Connection *conn) {
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        worker->connections = conn->next;
+    }
+    if (conn->next != NULL) conn->next->prev = conn->prev;
+
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+/** @brief Aktualizuje zdarzenia, na które połączenie jest zarejestrowane w epoll.
+ * Połączenie czeka na możliwość zapisu, gdy ma niewysłane odpowiedzi, i przestaje czytać żądania, gdy
+ * niewysłanych odpowiedzi jest za dużo albo klient zakończył wysyłanie żądań.
+ * @param worker - wskaźnik na wątek.
+ * @param conn - wskaźnik na połączenie.
+ * @return Wartość @p true, jeśli się udało, lub @p false w przeciwnym wypadku.
+ */
+static bool connectionUpdateEvents(Worker *worker, Connection *conn) {
+    size_t pending = conn->out_size - conn->out_begin;
+    uint32_t events = 0;
+    if (!conn->eof) events |= EPOLLRDHUP;
+    if (!conn->eof && pending < SERVER_OUTPUT_LIMIT) events |= EPOLLIN;
+    if (pending > 0) events |= EPOLLOUT;
+    if (events == conn->events) return true;
+
+    struct epoll_event ev = {.events = events, .data.ptr = conn};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) return false;
+    conn->events = events;
+    return true;
+}
+
+/** @brief Wykonuje żądanie i dopisuje odpowiedź do bufora odpowiedzi.
+ * @param conn - wskaźnik na połączenie.
+ * @param header - wskaźnik na nagłówek żądania.
+ * @param data - wskaźnik na numer z żądania, niezakończony znakiem '\\0'.
+ * @return Wartość @p true, jeśli się udało, lub @p false, gdy nie udało się alokować pamięci na odpowiedź.
+ */
+static bool connectionHandle(Connection *conn, const PhoneForwardRequestHeader *header, const char *data) {
+    char num[PHIPC_MAX_NUMBER_LENGTH + 1];
+    memcpy(num, data, header->length);
+    num[header->length] = '\0';
+
+    PhoneForwardResponseHeader response = {header->id, PHIPC_STATUS_OK, header->op, 0, 0, 0};
+    PhoneNumbers *pnum = NULL;
+    switch (header->op) {
+        case PHIPC_OP_GET:
+            pnum = phfwdGet(server_table, num);
+            break;
+        case PHIPC_OP_REVERSE:
+            pnum = phfwdReverse(server_table, num);
+            break;
+        case PHIPC_OP_GET_REVERSE:
+            pnum = phfwdGetReverse(server_table, num);
+            break;
+        default:
+            response.status = PHIPC_STATUS_BAD_REQUEST;
+    }
+    if (response.status == PHIPC_STATUS_OK && pnum == NULL) response.status = PHIPC_STATUS_NO_MEMORY;
+
+    size_t length = 0;
+    const char *res;
+    for (size_t i = 0; (res = phnumGet(pnum, i)) != NULL; i++) {
+        length += strlen(res) + 1;
+        response.count++;
+    }
+    response.length = (uint32_t) length;
+
+    if (!serverReserve(&conn->out, &conn->out_capacity, conn->out_size + PHIPC_RESPONSE_HEADER_SIZE + length)) {
+        phnumDelete(pnum);
+        return false;
+    }
+    memcpy(conn->out + conn->out_size, &response, PHIPC_RESPONSE_HEADER_SIZE);
+    conn->out_size += PHIPC_RESPONSE_HEADER_SIZE;
+    for (size_t i = 0; (res = phnumGet(pnum, i)) != NULL; i++) {
+        size_t len = strlen(res) + 1;
+        memcpy(conn->out + conn->out_size, res, len);
+        conn->out_size += len;
+    }
+    phnumDelete(pnum);
+    return true;
+}
+
+/** @brief Wysyła odpowiedzi z bufora, dopóki gniazdo je przyjmuje.
+ * @param conn - wskaźnik na połączenie.
+ * @return Wartość @p true, jeśli połączenie jest dalej otwarte, lub @p false w przeciwnym wypadku.
+ */
+static bool connectionWrite(Connection *conn) {
+    while (conn->out_begin < conn->out_size) {
+        ssize_t res = send(conn->fd, conn->out + conn->out_begin, conn->out_size - conn->out_begin, MSG_NOSIGNAL);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->out_begin += (size_t) res;
+    }
+    conn->out_begin = 0;
+    conn->out_size = 0;
+    return true;
+}
+
+/** @brief Czyta żądania z gniazda i wykonuje wszystkie kompletne żądania.
+ * Gdy klient zakończy wysyłanie, oznacza połączenie, żeby zostało zamknięte dopiero po wysłaniu odpowiedzi.
+ * @param conn - wskaźnik na połączenie.
+ * @return Wartość @p true, jeśli połączenie jest dalej otwarte, lub @p false w przeciwnym wypadku.
+ */
+static bool connectionRead(Connection *conn) {
+    while (conn->out_size - conn->out_begin < SERVER_OUTPUT_LIMIT) {
+        if (!serverReserve(&conn->in, &conn->in_capacity, conn->in_size + 4096)) return false;
+
+        ssize_t res = recv(conn->fd, conn->in + conn->in_size, conn->in_capacity - conn->in_size, 0);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        if (res == 0) {
+            // Niepełne żądanie na końcu bufora nie zostanie już uzupełnione.
+            conn->eof = true;
+            break;
+        }
+        conn->in_size += (size_t) res;
+
+        size_t pos = 0;
+        PhoneForwardRequestHeader header;
+        while (conn->in_size - pos >= PHIPC_REQUEST_HEADER_SIZE) {
+            memcpy(&header, conn->in + pos, PHIPC_REQUEST_HEADER_SIZE);
+            if (conn->in_size - pos < PHIPC_REQUEST_HEADER_SIZE + (size_t) header.length) break;
+            if (!connectionHandle(conn, &header, conn->in + pos + PHIPC_REQUEST_HEADER_SIZE)) return false;
+            pos += PHIPC_REQUEST_HEADER_SIZE + header.length;
+        }
+        memmove(conn->in, conn->in + pos, conn->in_size - pos);
+        conn->in_size -= pos;
+
+        if (!connectionWrite(conn)) return false;
+    }
+    return true;
+}
+
+/** @brief Przyjmuje oczekujące połączenia i rejestruje je w pętli epoll wątku.
+ * @param worker - wskaźnik na wątek.
+ */
+static void workerAccept(Worker *worker) {
+    while (true) {
+        int fd = accept4(server_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (conn != NULL) {
+            conn->in_capacity = 4096;
+            conn->in = malloc(conn->in_capacity);
+            conn->out_capacity = 4096;
+            conn->out = malloc(conn->out_capacity);
+        }
+        if (conn == NULL || conn->in == NULL || conn->out == NULL) {
+            if (conn != NULL) {
+                free(conn->in);
+                free(conn->out);
+                free(conn);
+            }
+            close(fd);
+            continue;
+        }
+
+        conn->fd = fd;
+        conn->events = EPOLLIN | EPOLLRDHUP;
+        conn->next = worker->connections;
+        if (conn->next != NULL) conn->next->prev = conn;
+        worker->connections = conn;
+
+        struct epoll_event ev = {.events = conn->events, .data.ptr = conn};
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) connectionClose(worker, conn);
+    }
+}
+
+/** @brief Pętla zdarzeń wątku roboczego.
+ * @param arg - wskaźnik na wątek.
+ * @return NULL.
+ */
+static void *workerRun(void *arg) {
+    Worker *worker = arg;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    while (!server_stop) {
+        int n = epoll_wait(worker->epoll_fd, events, SERVER_MAX_EVENTS, 200);
+        for (int i = 0; i < n; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                workerAccept(worker);
+                continue;
+            }
+
+            bool open = true;
+            if (events[i].events & EPOLLOUT) open = connectionWrite(conn);
+            if (open && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                open = connectionRead(conn);
+            }
+            if (open && conn->eof && conn->out_begin == conn->out_size) open = false;
+            if (open) open = connectionUpdateEvents(worker, conn);
+            if (!open) connectionClose(worker, conn);
+        }
+    }
+
+    while (worker->connections != NULL) connectionClose(worker, worker->connections);
+    return NULL;
+}
+
+/** @brief Wczytuje przekierowania z pliku.
+ * @param pf - wskaźnik na strukturę przekierowań.
+ * @param path - ścieżka pliku.
+ * @return Wartość @p true, jeśli się udało, lub @p false w przeciwnym wypadku.
+ */
+static bool serverLoad(PhoneForward *pf, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    size_t added = 0, rejected = 0;
+    while (getline(&line, &line_capacity, file) >= 0) {
+        char *save = NULL;
+        char *num1 = strtok_r(line, " \t\r\n", &save);
+        char *num2 = strtok_r(NULL, " \t\r\n", &save);
+        if (num1 == NULL) continue;
+        if (num2 != NULL && phfwdAdd(pf, num1, num2)) {
+            added++;
+        } else {
+            rejected++;
+        }
+    }
+    free(line);
+    fclose(file);
+    fprintf(stderr, "loaded %zu forwards, rejected %zu lines\n", added, rejected);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s socket_path [forwards_file] [workers]\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[1];
+    long worker_amount = argc > 3 ? strtol(argv[3], NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_amount < 1) worker_amount = 1;
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "socket path too long\n");
+        return 1;
+    }
+
+    server_table = phfwdNew();
+    if (server_table == NULL || (argc > 2 && !serverLoad(server_table, argv[2]))) {
+        fprintf(stderr, "cannot load forwards\n");
+        phfwdDelete(server_table);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = serverSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    server_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_listen_fd < 0 || bind(server_listen_fd, (struct sockaddr *) &addr, sizeof addr) != 0 ||
+        listen(server_listen_fd, SOMAXCONN) != 0) {
+        perror("listen");
+        phfwdDelete(server_table);
+        return 1;
+    }
+
+    Worker *workers = calloc((size_t) worker_amount, sizeof(Worker));
+    if (workers == NULL) {
+        close(server_listen_fd);
+        phfwdDelete(server_table);
+        return 1;
+    }
+
+    long started = 0;
+    for (; started < worker_amount; started++) {
+        Worker *worker = &workers[started];
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+        if (worker->epoll_fd < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, server_listen_fd, &ev) != 0 ||
+            pthread_create(&worker->thread, NULL, workerRun, worker) != 0) {
+            perror("worker");
+            if (worker->epoll_fd >= 0) close(worker->epoll_fd);
+            server_stop = 1;
+            break;
+        }
+    }
+    fprintf(stderr, "listening on %s with %ld workers\n", path, started);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epoll_fd);
+    }
+
+    free(workers);
+    close(server_listen_fd);
+    unlink(path);
+    phfwdDelete(server_table);
+    return 0;
+}
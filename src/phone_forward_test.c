@@ -0,0 +1,890 @@
+/** @file
+ * Test różnicowy struktury przechowującej przekierowania numerów telefonów
+ *
+ * Użycie: phone_forward_test [ziarno] [liczba_operacji]
+ *
+ * Wykonuje losowe ciągi operacji na podstawowej strukturze oraz na zoptymalizowanych ścieżkach biblioteki: strukturze
+ * z alokatorem z areny i przenoszonymi węzłami, zapytaniach z przeplotem, postaci zamrożonej, równoległym wyznaczaniu
+ * przeciwobrazów i nakładce. Każdy wynik jest porównywany z wynikiem naiwnego modelu, który przechowuje przekierowania
+ * w płaskiej tablicy i nie korzysta z biblioteki.
+ *
+ * Wywołania malloc, calloc, realloc i free są przechwytywane opcją konsolidatora --wrap, więc test zlicza alokacje
+ * wykonywane przez każdą operację. Operacje na gorących ścieżkach mają ustalony limit alokacji, a zapytania nie mogą
+ * pozostawiać niezwolnionej pamięci. Przekroczenie limitu lub różnica wyników kończy test błędem.
+ *
+ * @author Jan Ossowski <marpe@mimuw.edu.pl>
+ * @date 2022
+ */
+
+#include "phone_forward.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Maksymalna długość losowanych numerów.
+ */
+#define TEST_MAX_LEN 7
+
+/** @brief Co ile operacji sprawdzane są postać zamrożona, nakładka i przenoszenie węzłów.
+ */
+#define TEST_CHECKPOINT 64
+
+/** @brief Liczba zapytań wykonywanych jednym wywołaniem phfwdGetBatch.
+ */
+#define TEST_BATCH 8
+
+/** @brief Liczba numerów przekierowywanych na wspólny prefiks w teście dużego przeciwobrazu.
+ * Równoległe wyznaczanie przeciwobrazu dzieli inwersje na fragmenty po 4096, więc inwersje trafiają do czterech
+ * fragmentów, a ostatni jest niepełny.
+ */
+#define TEST_FAN_IN (3 * 4096 + 517)
+
+/** @brief Liczba przekierowań dodawanych w teście porządkowania po masowym usuwaniu.
+ */
+#define TEST_BULK 5000
+
+/** @brief Rodzaje mierzonych operacji.
+ */
+enum TestOp {
+    TEST_ADD,
+    TEST_REMOVE,
+    TEST_GET,
+    TEST_GET_BATCH,
+    TEST_REVERSE,
+    TEST_GET_REVERSE,
+    TEST_FROZEN_GET,
+    TEST_FROZEN_GET_INTO,
+    TEST_OVERLAY_GET,
+    TEST_OP_AMOUNT
+};
+
+/** @brief Nazwy mierzonych operacji.
+ */
+static const char *const test_op_names[TEST_OP_AMOUNT] = {
+    "phfwdAdd", "phfwdRemove", "phfwdGet", "phfwdGetBatch", "phfwdReverse", "phfwdGetReverse",
+    "phfwdFrozenGet", "phfwdFrozenGetInto", "phfwdOverlayGet"};
+
+/** @brief Liczniki alokacji przechwyconych od początku działania programu.
+ * Alokacje wykonują też wątki puli równoległego wyznaczania przeciwobrazów, więc liczniki są zmieniane i odczytywane
+ * atomowo.
+ */
+static struct {
+    //! Liczba wywołań malloc, calloc oraz realloc z pustym wskaźnikiem.
+    uint64_t allocs;
+    //! Liczba wywołań realloc z niepustym wskaźnikiem.
+    uint64_t reallocs;
+    //! Liczba zwolnień niepustych wskaźników.
+    uint64_t frees;
+    //! Łączna liczba żądanych bajtów.
+    uint64_t bytes;
+} test_counters;
+
+/** @brief Sumy alokacji wykonanych przez poszczególne rodzaje operacji.
+ */
+static struct {
+    //! Liczba wykonanych operacji.
+    uint64_t calls;
+    //! Liczba alokacji.
+    uint64_t allocs;
+    //! Liczba żądanych bajtów.
+    uint64_t bytes;
+} test_stats[TEST_OP_AMOUNT];
+
+/** @brief Stan generatora liczb pseudolosowych.
+ */
+static uint64_t test_seed;
+
+/** @brief Numer aktualnej operacji, wypisywany przy błędzie.
+ */
+static size_t test_step;
+
+/** @brief Czy powiększanie pamięci przez realloc ma się nie udawać.
+ */
+static bool test_fail_realloc;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+/** @brief Przechwycone wywołanie malloc.
+ * @param size - rozmiar pamięci.
+ * @return Wynik malloc.
+ */
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&test_counters.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&test_counters.bytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+/** @brief Przechwycone wywołanie calloc.
+ * @param nmemb - liczba elementów.
+ * @param size - rozmiar elementu.
+ * @return Wynik calloc.
+ */
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    __atomic_fetch_add(&test_counters.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&test_counters.bytes, nmemb * size, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+/** @brief Przechwycone wywołanie realloc.
+ * @param ptr - wskaźnik na powiększaną pamięć lub NULL.
+ * @param size - nowy rozmiar pamięci.
+ * @return Wynik realloc.
+ */
+void *__wrap_realloc(void *ptr, size_t size) {
+    if (ptr != NULL && test_fail_realloc) return NULL;
+    if (ptr == NULL) {
+        __atomic_fetch_add(&test_counters.allocs, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&test_counters.reallocs, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&test_counters.bytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+/** @brief Przechwycone wywołanie free.
+ * @param ptr - wskaźnik na zwalnianą pamięć.
+ */
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) __atomic_fetch_add(&test_counters.frees, 1, __ATOMIC_RELAXED);
+    __real_free(ptr);
+}
+
+/** @brief Odczytuje licznik alokacji.
+ * @param counter - wskaźnik na licznik.
+ * @return Wartość licznika.
+ */
+static uint64_t testCounter(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/** @brief Zwraca kolejną liczbę pseudolosową.
+ * @return Liczba pseudolosowa.
+ */
+static uint64_t testRand(void) {
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 7;
+    test_seed ^= test_seed << 17;
+    return test_seed;
+}
+
+/** @brief Zapisuje do @p num losowy numer.
+ * Cyfry są losowane z małego zbioru, żeby numery często miały wspólne prefiksy. Czasem numer zawiera nieprawidłowy
+ * znak. Bez znaków '*' i '#' ich miejsce zajmują cyfry 9 i 8, więc w obu wariantach zbiór ma sześć pozycji o tym samym
+ * rozkładzie, a drzewa mają podobny kształt.
+ * @param num - wskaźnik na bufor o rozmiarze co najmniej TEST_MAX_LEN + 1.
+ */
+static void testRandomNumber(char *num) {
+#ifdef PHONE_NUMBER_DIGITS_ONLY
+    static const char digits[] = "012198";
+#else
+    static const char digits[] = "0121*#";
+#endif
+    size_t len = 1 + testRand() % TEST_MAX_LEN;
+    for (size_t i = 0; i < len; i++) {
+        num[i] = digits[testRand() % (sizeof digits - 1)];
+    }
+    if (testRand() % 64 == 0) num[testRand() % len] = 'a';
+    num[len] = '\0';
+}
+
+/** @brief Kończy test z komunikatem o błędzie.
+ * @param what - opis błędu.
+ * @param num - numer, którego dotyczyła operacja.
+ */
+static void testFail(const char *what, const char *num) {
+    fprintf(stderr, "FAIL at operation %zu: %s (number \"%s\")\n", test_step, what, num);
+    exit(1);
+}
+
+/** @brief Porównuje wynik kandydata z wynikiem wzorca.
+ * Zwalnia oba ciągi i kończy test, jeżeli się różnią.
+ * @param expected - wynik wzorca.
+ * @param actual - wynik kandydata.
+ * @param what - nazwa kandydata.
+ * @param num - numer, którego dotyczyło zapytanie.
+ */
+static void testCompare(PhoneNumbers *expected, PhoneNumbers *actual, const char *what, const char *num) {
+    if (expected == NULL || actual == NULL) testFail("allocation failed", num);
+    for (size_t i = 0;; i++) {
+        const char *x = phnumGet(expected, i);
+        const char *y = phnumGet(actual, i);
+        if (x == NULL && y == NULL) break;
+        if (x == NULL || y == NULL || strcmp(x, y) != 0) {
+            fprintf(stderr, "  index %zu: expected \"%s\", got \"%s\"\n", i, x == NULL ? "(end)" : x,
+                    y == NULL ? "(end)" : y);
+            testFail(what, num);
+        }
+    }
+    phnumDelete(expected);
+    phnumDelete(actual);
+}
+
+/** @brief Stan liczników alokacji zapamiętany przed operacją.
+ */
+typedef struct TestMark {
+    //! Liczba alokacji.
+    uint64_t allocs;
+    //! Liczba zwolnień.
+    uint64_t frees;
+    //! Liczba żądanych bajtów.
+    uint64_t bytes;
+} TestMark;
+
+/** @brief Zapamiętuje stan liczników alokacji.
+ * @return Stan liczników.
+ */
+static TestMark testMark(void) {
+    TestMark mark = {testCounter(&test_counters.allocs), testCounter(&test_counters.frees),
+                     testCounter(&test_counters.bytes)};
+    return mark;
+}
+
+/** @brief Dolicza alokacje wykonane od @p mark do statystyk operacji i sprawdza limit.
+ * @param op - rodzaj operacji.
+ * @param mark - stan liczników przed operacją.
+ * @param limit - największa dopuszczalna liczba alokacji lub UINT64_MAX, jeżeli operacja nie ma limitu.
+ * @param num - numer, którego dotyczyła operacja.
+ * @return Liczba alokacji wykonanych przez operację.
+ */
+static uint64_t testAccount(enum TestOp op, TestMark mark, uint64_t limit, const char *num) {
+    uint64_t allocs = testCounter(&test_counters.allocs) - mark.allocs;
+    test_stats[op].calls++;
+    test_stats[op].allocs += allocs;
+    test_stats[op].bytes += testCounter(&test_counters.bytes) - mark.bytes;
+    if (allocs > limit) {
+        fprintf(stderr, "  %s: %" PRIu64 " allocations, limit %" PRIu64 "\n", test_op_names[op], allocs, limit);
+        testFail("allocation budget exceeded", num);
+    }
+    return allocs;
+}
+
+/** @brief Sprawdza, że od @p mark zwolniono dokładnie tyle bloków, ile przydzielono.
+ * @param mark - stan liczników przed zapytaniem.
+ * @param what - nazwa zapytania.
+ * @param num - numer, którego dotyczyło zapytanie.
+ */
+static void testNoLeak(TestMark mark, const char *what, const char *num) {
+    TestMark now = testMark();
+    if (now.allocs - mark.allocs != now.frees - mark.frees) testFail(what, num);
+}
+
+/** @brief Maksymalna długość numeru w wyniku modelu.
+ * Wynik powstaje z numeru docelowego lub źródłowego i sufiksu zapytania, więc ma co najwyżej dwa razy tyle znaków co
+ * losowany numer.
+ */
+#define TEST_RESULT_LEN (2 * TEST_MAX_LEN)
+
+/** @brief Przekierowanie przechowywane w modelu.
+ */
+typedef struct TestPair {
+    //! Numer przekierowywany.
+    char source[TEST_MAX_LEN + 1];
+    //! Numer, na który przekierowano @p source.
+    char target[TEST_MAX_LEN + 1];
+} TestPair;
+
+/** @brief Naiwny model struktury: płaska tablica przekierowań przeszukiwana liniowo.
+ * Model nie korzysta z biblioteki, więc wyniki wszystkich jej wariantów, łącznie ze wzorcem, są porównywane z nim.
+ */
+typedef struct TestModel {
+    //! Tablica przekierowań.
+    TestPair *pairs;
+    //! Liczba przekierowań.
+    size_t amount;
+    //! Rozmiar tablicy @p pairs.
+    size_t capacity;
+} TestModel;
+
+/** @brief Wynik zapytania do modelu.
+ */
+typedef struct TestResult {
+    //! Posortowane numery bez powtórzeń.
+    char (*nums)[TEST_RESULT_LEN + 1];
+    //! Liczba numerów.
+    size_t amount;
+} TestResult;
+
+/** @brief Zwraca pozycję znaku w porządku numerów.
+ * @param c - znak.
+ * @return Pozycja znaku: cyfry od 0 do 9, '*' jako 10 i '#' jako 11, lub -1 dla innego znaku.
+ */
+static int testModelIndex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+#ifndef PHONE_NUMBER_DIGITS_ONLY
+    if (c == '*') return 10;
+    if (c == '#') return 11;
+#endif
+    return -1;
+}
+
+/** @brief Sprawdza, czy @p num jest poprawnym numerem.
+ * @param num - wskaźnik na napis.
+ * @return Wartość @p true, jeżeli napis jest niepusty i składa się tylko z cyfr, lub @p false w przeciwnym wypadku.
+ */
+static bool testModelIsNumber(const char *num) {
+    if (num[0] == '\0') return false;
+    for (size_t i = 0; num[i] != '\0'; i++) {
+        if (testModelIndex(num[i]) < 0) return false;
+    }
+    return true;
+}
+
+/** @brief Sprawdza, czy @p prefix jest prefiksem @p num.
+ * @param prefix - wskaźnik na prefiks.
+ * @param num - wskaźnik na numer.
+ * @return Wartość @p true, jeżeli @p num zaczyna się od @p prefix, lub @p false w przeciwnym wypadku.
+ */
+static bool testModelIsPrefix(const char *prefix, const char *num) {
+    return strncmp(prefix, num, strlen(prefix)) == 0;
+}
+
+/** @brief Porównuje numery w porządku wyników biblioteki.
+ * @param a - wskaźnik na pierwszy numer.
+ * @param b - wskaźnik na drugi numer.
+ * @return Liczba ujemna, zero lub dodatnia, jeżeli pierwszy numer jest odpowiednio mniejszy, równy lub większy.
+ */
+static int testModelCompare(const void *a, const void *b) {
+    const char *x = a, *y = b;
+    size_t i = 0;
+    while (x[i] != '\0' && y[i] != '\0' && x[i] == y[i]) i++;
+    if (x[i] == '\0' || y[i] == '\0') return (y[i] == '\0') - (x[i] == '\0');
+    return testModelIndex(x[i]) - testModelIndex(y[i]);
+}
+
+/** @brief Dodaje przekierowanie do modelu, zastępując dotychczasowe przekierowanie @p source.
+ * @param model - wskaźnik na model.
+ * @param source - wskaźnik na numer przekierowywany.
+ * @param target - wskaźnik na numer docelowy.
+ * @return Wartość @p true, jeżeli przekierowanie zostało dodane, lub @p false, jeżeli numery są niepoprawne lub równe.
+ */
+static bool testModelAdd(TestModel *model, const char *source, const char *target) {
+    if (!testModelIsNumber(source) || !testModelIsNumber(target) || strcmp(source, target) == 0) return false;
+    for (size_t i = 0; i < model->amount; i++) {
+        if (strcmp(model->pairs[i].source, source) == 0) {
+            strcpy(model->pairs[i].target, target);
+            return true;
+        }
+    }
+    if (model->amount == model->capacity) {
+        model->capacity = model->capacity == 0 ? 64 : 2 * model->capacity;
+        model->pairs = realloc(model->pairs, model->capacity * sizeof(TestPair));
+        if (model->pairs == NULL) testFail("model allocation failed", source);
+    }
+    strcpy(model->pairs[model->amount].source, source);
+    strcpy(model->pairs[model->amount].target, target);
+    model->amount++;
+    return true;
+}
+
+/** @brief Usuwa z modelu przekierowania wszystkich numerów, których prefiksem jest @p num.
+ * @param model - wskaźnik na model.
+ * @param num - wskaźnik na prefiks.
+ */
+static void testModelRemove(TestModel *model, const char *num) {
+    if (!testModelIsNumber(num)) return;
+    for (size_t i = 0; i < model->amount;) {
+        if (testModelIsPrefix(num, model->pairs[i].source)) {
+            model->pairs[i] = model->pairs[--model->amount];
+        } else {
+            i++;
+        }
+    }
+}
+
+/** @brief Wyznacza w modelu przekierowanie numeru według najdłuższego pasującego prefiksu.
+ * @param model - wskaźnik na model.
+ * @param num - wskaźnik na poprawny numer.
+ * @param res - bufor o rozmiarze co najmniej TEST_RESULT_LEN + 1.
+ */
+static void testModelGetInto(const TestModel *model, const char *num, char *res) {
+    const TestPair *best = NULL;
+    for (size_t i = 0; i < model->amount; i++) {
+        const TestPair *pair = &model->pairs[i];
+        if (testModelIsPrefix(pair->source, num) && (best == NULL || strlen(pair->source) > strlen(best->source))) {
+            best = pair;
+        }
+    }
+    if (best == NULL) {
+        strcpy(res, num);
+    } else {
+        strcpy(res, best->target);
+        strcat(res, num + strlen(best->source));
+    }
+}
+
+/** @brief Przydziela wynik zapytania do modelu.
+ * @param amount - największa liczba numerów wyniku.
+ * @return Pusty wynik.
+ */
+static TestResult testResultNew(size_t amount) {
+    TestResult res = {malloc(amount * sizeof *res.nums), 0};
+    if (res.nums == NULL) testFail("model allocation failed", "");
+    return res;
+}
+
+/** @brief Zwalnia wynik zapytania do modelu.
+ * @param res - wskaźnik na wynik.
+ */
+static void testResultDelete(TestResult *res) {
+    free(res->nums);
+}
+
+/** @brief Wyznacza w modelu wynik phfwdGet.
+ * @param model - wskaźnik na model.
+ * @param num - wskaźnik na numer.
+ * @return Jeden numer lub pusty wynik dla niepoprawnego numeru.
+ */
+static TestResult testModelGet(const TestModel *model, const char *num) {
+    TestResult res = testResultNew(1);
+    if (testModelIsNumber(num)) testModelGetInto(model, num, res.nums[res.amount++]);
+    return res;
+}
+
+/** @brief Wyznacza w modelu wynik phfwdReverse.
+ * @param model - wskaźnik na model.
+ * @param num - wskaźnik na numer.
+ * @return Posortowane numery bez powtórzeń, zawsze z samym @p num, lub pusty wynik dla niepoprawnego numeru.
+ */
+static TestResult testModelReverse(const TestModel *model, const char *num) {
+    TestResult res = testResultNew(model->amount + 1);
+    if (!testModelIsNumber(num)) return res;
+
+    strcpy(res.nums[res.amount++], num);
+    for (size_t i = 0; i < model->amount; i++) {
+        const TestPair *pair = &model->pairs[i];
+        if (testModelIsPrefix(pair->target, num)) {
+            strcpy(res.nums[res.amount], pair->source);
+            strcat(res.nums[res.amount++], num + strlen(pair->target));
+        }
+    }
+    qsort(res.nums, res.amount, sizeof *res.nums, testModelCompare);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < res.amount; i++) {
+        if (unique == 0 || strcmp(res.nums[unique - 1], res.nums[i]) != 0) {
+            memmove(res.nums[unique++], res.nums[i], sizeof *res.nums);
+        }
+    }
+    res.amount = unique;
+    return res;
+}
+
+/** @brief Wyznacza w modelu wynik phfwdGetReverse.
+ * @param model - wskaźnik na model.
+ * @param num - wskaźnik na numer.
+ * @return Numery wyniku phfwdReverse, których przekierowaniem jest @p num.
+ */
+static TestResult testModelGetReverse(const TestModel *model, const char *num) {
+    char fwd[TEST_RESULT_LEN + 1];
+    TestResult res = testModelReverse(model, num);
+    size_t kept = 0;
+    for (size_t i = 0; i < res.amount; i++) {
+        testModelGetInto(model, res.nums[i], fwd);
+        if (strcmp(fwd, num) == 0) memmove(res.nums[kept++], res.nums[i], sizeof *res.nums);
+    }
+    res.amount = kept;
+    return res;
+}
+
+/** @brief Porównuje wynik biblioteki z wynikiem modelu.
+ * Zwalnia @p actual i kończy test, jeżeli wyniki się różnią.
+ * @param expected - wskaźnik na wynik modelu.
+ * @param actual - wynik biblioteki.
+ * @param what - nazwa sprawdzanej funkcji.
+ * @param num - numer, którego dotyczyło zapytanie.
+ */
+static void testCompareModel(const TestResult *expected, PhoneNumbers *actual, const char *what, const char *num) {
+    if (actual == NULL) testFail("allocation failed", num);
+    for (size_t i = 0;; i++) {
+        const char *x = i < expected->amount ? expected->nums[i] : NULL;
+        const char *y = phnumGet(actual, i);
+        if (x == NULL && y == NULL) break;
+        if (x == NULL || y == NULL || strcmp(x, y) != 0) {
+            fprintf(stderr, "  index %zu: model \"%s\", got \"%s\"\n", i, x == NULL ? "(end)" : x,
+                    y == NULL ? "(end)" : y);
+            testFail(what, num);
+        }
+    }
+    phnumDelete(actual);
+}
+
+/** @brief Struktury porównywane z modelem.
+ */
+typedef struct TestEngines {
+    //! Naiwny model, z którym porównywane są wyniki wszystkich struktur.
+    TestModel model;
+    //! Wzorzec: podstawowa struktura, z którą porównywana jest zawartość struktury @p packed.
+    PhoneForward *reference;
+    //! Arena struktury @p packed.
+    PhoneForwardArena *arena;
+    //! Struktura z pamięcią z areny, zliczaniem odwiedzin i przenoszonymi węzłami.
+    PhoneForward *packed;
+    //! Baza nakładki, niezmieniana po utworzeniu nakładki.
+    PhoneForward *base;
+    //! Nakładka na bazę, do której trafiają wszystkie zmiany.
+    PhoneForwardOverlay *overlay;
+    //! Pula wątków równoległego wyznaczania przeciwobrazów.
+    PhoneForwardThreadPool *pool;
+    //! Stan przyrostowego porządkowania struktury @p packed.
+    PhoneForwardCompactor *compactor;
+} TestEngines;
+
+/** @brief Sprawdza zapytania phfwdGet, phfwdReverse i phfwdGetReverse dla jednego numeru.
+ * @param engines - wskaźnik na porównywane struktury.
+ * @param num - wskaźnik na numer.
+ */
+static void testQuery(TestEngines *engines, const char *num) {
+    TestResult get = testModelGet(&engines->model, num);
+    TestResult reverse = testModelReverse(&engines->model, num);
+    TestResult get_reverse = testModelGetReverse(&engines->model, num);
+
+    TestMark mark = testMark();
+    PhoneNumbers *actual = phfwdGet(engines->reference, num);
+    // Wynik phfwdGet to struktura, tablica numerów i jeden numer.
+    testAccount(TEST_GET, mark, 3, num);
+    testCompareModel(&get, actual, "phfwdGet", num);
+    testCompareModel(&get, phfwdGet(engines->packed, num), "phfwdGet on arena with relocation", num);
+    testNoLeak(mark, "phfwdGet leaked memory", num);
+
+    mark = testMark();
+    actual = phfwdOverlayGet(engines->overlay, num);
+    testAccount(TEST_OVERLAY_GET, mark, 3, num);
+    testCompareModel(&get, actual, "phfwdOverlayGet", num);
+
+    mark = testMark();
+    actual = phfwdReverse(engines->reference, num);
+    testAccount(TEST_REVERSE, mark, UINT64_MAX, num);
+    testCompareModel(&reverse, actual, "phfwdReverse", num);
+    testCompareModel(&reverse, phfwdReverse(engines->packed, num), "phfwdReverse on arena with relocation", num);
+    testNoLeak(mark, "phfwdReverse leaked memory", num);
+    testCompareModel(&reverse, phfwdReverseParallel(engines->reference, num, engines->pool), "phfwdReverseParallel",
+                     num);
+    testCompareModel(&reverse, phfwdOverlayReverse(engines->overlay, num), "phfwdOverlayReverse", num);
+
+    mark = testMark();
+    actual = phfwdGetReverse(engines->reference, num);
+    testAccount(TEST_GET_REVERSE, mark, UINT64_MAX, num);
+    testCompareModel(&get_reverse, actual, "phfwdGetReverse", num);
+    testCompareModel(&get_reverse, phfwdGetReverse(engines->packed, num), "phfwdGetReverse on arena with relocation",
+                     num);
+    testNoLeak(mark, "phfwdGetReverse leaked memory", num);
+    testCompareModel(&get_reverse, phfwdGetReverseParallel(engines->reference, num, engines->pool),
+                     "phfwdGetReverseParallel", num);
+    testCompareModel(&get_reverse, phfwdOverlayGetReverse(engines->overlay, num), "phfwdOverlayGetReverse", num);
+
+    testResultDelete(&get);
+    testResultDelete(&reverse);
+    testResultDelete(&get_reverse);
+}
+
+/** @brief Sprawdza zapytania z przeplotem dla kilku losowych numerów.
+ * @param engines - wskaźnik na porównywane struktury.
+ */
+static void testBatch(TestEngines *engines) {
+    char nums[TEST_BATCH][TEST_MAX_LEN + 1];
+    const char *ptrs[TEST_BATCH];
+    PhoneNumbers *results[TEST_BATCH];
+    for (size_t i = 0; i < TEST_BATCH; i++) {
+        testRandomNumber(nums[i]);
+        ptrs[i] = nums[i];
+    }
+
+    TestMark mark = testMark();
+    if (!phfwdGetBatch(engines->reference, ptrs, TEST_BATCH, results)) testFail("phfwdGetBatch failed", nums[0]);
+    testAccount(TEST_GET_BATCH, mark, 3 * TEST_BATCH, nums[0]);
+    for (size_t i = 0; i < TEST_BATCH; i++) {
+        TestResult get = testModelGet(&engines->model, nums[i]);
+        testCompareModel(&get, results[i], "phfwdGetBatch", nums[i]);
+        testResultDelete(&get);
+    }
+}
+
+/** @brief Porównuje postać zamrożoną z modelem i sprawdza, że struktura z areny nie różni się od wzorca.
+ * Na koniec przenosi część węzłów struktury z areny i porządkuje jej porcję.
+ * @param engines - wskaźnik na porównywane struktury.
+ */
+static void testCheckpoint(TestEngines *engines) {
+    char num[TEST_MAX_LEN + 1], buf[2 * TEST_MAX_LEN + 2];
+
+    PhoneForwardDiff *diff = phfwdDiffNew(engines->reference, engines->packed);
+    char const *diff_num, *old_fwd, *new_fwd;
+    if (diff == NULL) testFail("phfwdDiffNew failed", "");
+    if (phfwdDiffNext(diff, &diff_num, &old_fwd, &new_fwd)) testFail("arena table differs from reference", diff_num);
+    if (phfwdDiffFailed(diff)) testFail("phfwdDiffNext failed", "");
+    phfwdDiffDelete(diff);
+
+    PhoneForwardFrozen *pff = phfwdFreeze(engines->reference);
+    if (pff == NULL) testFail("phfwdFreeze failed", "");
+    for (int i = 0; i < 32; i++) {
+        testRandomNumber(num);
+        TestResult get = testModelGet(&engines->model, num);
+        TestResult reverse = testModelReverse(&engines->model, num);
+
+        TestMark mark = testMark();
+        PhoneNumbers *actual = phfwdFrozenGet(pff, num);
+        testAccount(TEST_FROZEN_GET, mark, 3, num);
+        testCompareModel(&get, actual, "phfwdFrozenGet", num);
+
+        mark = testMark();
+        size_t len = phfwdFrozenGetInto(pff, num, buf, sizeof buf);
+        testAccount(TEST_FROZEN_GET_INTO, mark, 0, num);
+        const char *res = get.amount == 0 ? NULL : get.nums[0];
+        if ((res == NULL && len != 0) || (res != NULL && (len != strlen(res) || strcmp(buf, res) != 0))) {
+            testFail("phfwdFrozenGetInto", num);
+        }
+
+        testCompareModel(&reverse, phfwdFrozenReverse(pff, num), "phfwdFrozenReverse", num);
+        testResultDelete(&get);
+        testResultDelete(&reverse);
+    }
+    phfwdFrozenDelete(pff);
+
+    phfwdRelocate(engines->packed, 1 + testRand() % 64);
+    phfwdCompact(engines->packed, engines->compactor, 1 + testRand() % 64, NULL);
+}
+
+/** @brief Porównuje równoległe wyznaczanie przeciwobrazów z sekwencyjnym dla dużego przeciwobrazu.
+ * Numery x są przekierowywane na "9", a numery x8 na "98", więc x87 trafia do przeciwobrazu "987" z dwóch inwersji.
+ * Pierwsze pary są dodawane obok siebie, a pozostałe w dwóch seriach, więc powtórzenia leżą zarówno w jednym
+ * fragmencie, jak i w różnych fragmentach, a wynik scalania musi je usunąć.
+ * @return Wartość @p true, jeżeli nie udało się utworzyć struktur, lub @p false w przeciwnym wypadku.
+ */
+static bool testFanIn(void) {
+    static const char *nums[] = {"987", "98", "9", "9870", "1"};
+    char num[TEST_MAX_LEN + 2];
+
+    PhoneForward *pf = phfwdNew();
+    PhoneForwardThreadPool *pool = phfwdThreadPoolNew(3);
+    if (pf == NULL || pool == NULL) return false;
+
+    test_step = 0;
+    for (size_t i = 0; i < TEST_FAN_IN; i++) {
+        snprintf(num, sizeof num, "1%05zu", i);
+        if (!phfwdAdd(pf, num, "9")) testFail("phfwdAdd in fan-in failed", num);
+        if (i < 64) {
+            strcat(num, "8");
+            if (!phfwdAdd(pf, num, "98")) testFail("phfwdAdd in fan-in failed", num);
+        }
+    }
+    for (size_t i = 64; i < TEST_FAN_IN; i++) {
+        snprintf(num, sizeof num, "1%05zu8", i);
+        if (!phfwdAdd(pf, num, "98")) testFail("phfwdAdd in fan-in failed", num);
+    }
+
+    for (size_t i = 0; i < sizeof nums / sizeof nums[0]; i++) {
+        PhoneNumbers *res = phfwdReverseParallel(pf, nums[i], pool);
+        size_t amount = 0;
+        while (phnumGet(res, amount) != NULL) amount++;
+        // Każdy numer x daje jeden wynik, a dodatkowo wynik zawiera sam numer.
+        if (strcmp(nums[i], "1") != 0 && amount != TEST_FAN_IN + 1) testFail("fan-in result size", nums[i]);
+        testCompare(phfwdReverse(pf, nums[i]), res, "phfwdReverseParallel on fan-in", nums[i]);
+        testCompare(phfwdGetReverse(pf, nums[i]), phfwdGetReverseParallel(pf, nums[i], pool),
+                    "phfwdGetReverseParallel on fan-in", nums[i]);
+    }
+
+    phfwdThreadPoolDelete(pool);
+    phfwdDelete(pf);
+    return true;
+}
+
+/** @brief Sprawdza, że porządkowanie po masowym usuwaniu przekierowań usuwa puste ścieżki i zmniejsza tablice.
+ * Przekierowania długich numerów tworzą ścieżki węzłów, które po usunięciu przekierowań zostają puste. Najpierw
+ * usuwana jest pierwsza połowa numerów, więc puste zostają całe poddrzewa ich wspólnych prefiksów, a potem reszta.
+ * Po każdej fali porządkowanie musi odzyskać pamięć, a po usunięciu wszystkich przekierowań pamięć areny musi wrócić
+ * do stanu pustej struktury.
+ * @return Wartość @p true, jeżeli nie udało się utworzyć struktur, lub @p false w przeciwnym wypadku.
+ */
+static bool testCompactBulk(void) {
+    char num1[TEST_MAX_LEN + 1], num2[TEST_MAX_LEN + 1];
+
+    PhoneForwardArena *arena = phfwdArenaNew(0, false);
+    PhoneForwardAllocator allocator = phfwdArenaAllocator(arena);
+    PhoneForward *pf = phfwdNewWithAllocator(&allocator);
+    PhoneForwardCompactor *pc = phfwdCompactorNew();
+    if (arena == NULL || pf == NULL || pc == NULL) return false;
+    size_t empty = phfwdArenaInUse(arena);
+
+    test_step = 0;
+    for (size_t i = 0; i < TEST_BULK; i++) {
+        snprintf(num1, sizeof num1, "1%05zu", i);
+        snprintf(num2, sizeof num2, "2%zu", i);
+        if (!phfwdAdd(pf, num1, num2)) testFail("phfwdAdd in bulk removal failed", num1);
+    }
+
+    for (size_t wave = 0; wave < 2; wave++) {
+        for (size_t i = wave * TEST_BULK / 2; i < (wave + 1) * TEST_BULK / 2; i++) {
+            snprintf(num1, sizeof num1, "1%05zu", i);
+            phfwdRemove(pf, num1);
+        }
+        size_t removed = phfwdArenaInUse(arena);
+
+        size_t reclaimed = 0;
+        bool finished = false;
+        while (!finished) reclaimed += phfwdCompact(pf, pc, 16, &finished);
+        if (reclaimed == 0 || phfwdArenaInUse(arena) >= removed) testFail("bulk removal not reclaimed", "");
+    }
+    if (phfwdArenaInUse(arena) != empty) testFail("empty paths left after compaction", "");
+
+    phfwdCompactorDelete(pc);
+    phfwdDelete(pf);
+    phfwdArenaDelete(arena);
+    return true;
+}
+
+/** @brief Sprawdza, że brak pamięci przy wyznaczaniu różnic nie wygląda na ich koniec.
+ * Różnica leży głębiej niż początkowy rozmiar stosu iteratora, więc iterator musi go powiększyć. Najpierw
+ * powiększanie się udaje i iterator zwraca jedną różnicę, a potem każde realloc zawodzi i iterator musi to zgłosić.
+ * @return Wartość @p true, jeżeli nie udało się utworzyć struktur, lub @p false w przeciwnym wypadku.
+ */
+static bool testDiffFailure(void) {
+    static const char deep[] = "1234567890123456789012345678901234567890";
+    char const *num, *old_fwd, *new_fwd;
+
+    PhoneForward *pf_old = phfwdNew();
+    PhoneForward *pf_new = phfwdNew();
+    if (pf_old == NULL || pf_new == NULL || !phfwdAdd(pf_new, deep, "5")) return false;
+
+    for (int fail = 0; fail < 2; fail++) {
+        PhoneForwardDiff *diff = phfwdDiffNew(pf_old, pf_new);
+        if (diff == NULL) return false;
+        test_fail_realloc = fail;
+        size_t differences = 0;
+        while (phfwdDiffNext(diff, &num, &old_fwd, &new_fwd)) differences++;
+        test_fail_realloc = false;
+
+        if (fail && (differences != 0 || !phfwdDiffFailed(diff))) testFail("phfwdDiffNext hid a failure", deep);
+        if (!fail && (differences != 1 || phfwdDiffFailed(diff))) testFail("phfwdDiffNext on deep difference", deep);
+        // Błąd jest trwały, więc iterator nie wznawia przechodzenia z niepełnym stanem.
+        if (fail && phfwdDiffNext(diff, &num, &old_fwd, &new_fwd)) testFail("phfwdDiffNext after failure", deep);
+        phfwdDiffDelete(diff);
+    }
+
+    phfwdDelete(pf_old);
+    phfwdDelete(pf_new);
+    return true;
+}
+
+/** @brief Wykonuje losowy ciąg operacji i porównuje wyniki.
+ * @param seed - ziarno generatora liczb pseudolosowych.
+ * @param operations - liczba operacji.
+ * @return Wartość @p true, jeżeli nie udało się utworzyć struktur, lub @p false w przeciwnym wypadku.
+ */
+static bool testRun(uint64_t seed, size_t operations) {
+    char num1[TEST_MAX_LEN + 1], num2[TEST_MAX_LEN + 1];
+    TestEngines engines;
+
+    test_seed = seed == 0 ? 1 : seed;
+    engines.model = (TestModel) {NULL, 0, 0};
+    engines.reference = phfwdNew();
+    engines.base = phfwdNew();
+    engines.arena = phfwdArenaNew(0, false);
+    PhoneForwardAllocator allocator = phfwdArenaAllocator(engines.arena);
+    engines.packed = phfwdNewWithAllocator(&allocator);
+    engines.pool = phfwdThreadPoolNew(3);
+    engines.compactor = phfwdCompactorNew();
+    if (engines.reference == NULL || engines.base == NULL || engines.packed == NULL || engines.pool == NULL ||
+        engines.compactor == NULL) {
+        return false;
+    }
+    phfwdProfile(engines.packed, true);
+
+    // Pierwsza część przekierowań trafia do bazy nakładki, a reszta zmian tylko do nakładki.
+    for (size_t i = 0; i < 32; i++) {
+        testRandomNumber(num1);
+        testRandomNumber(num2);
+        testModelAdd(&engines.model, num1, num2);
+        phfwdAdd(engines.reference, num1, num2);
+        phfwdAdd(engines.packed, num1, num2);
+        phfwdAdd(engines.base, num1, num2);
+    }
+    engines.overlay = phfwdOverlayNew(engines.base);
+    if (engines.overlay == NULL) return false;
+
+    for (test_step = 0; test_step < operations; test_step++) {
+        uint64_t kind = testRand() % 16;
+        testRandomNumber(num1);
+        testRandomNumber(num2);
+
+        if (kind < 5) {
+            TestMark mark = testMark();
+            bool added = phfwdAdd(engines.reference, num1, num2);
+            // Nowe węzły ścieżki po dwie alokacje, inwersja dwie, numer docelowy, tablica inwersji i kubełki puli.
+            testAccount(TEST_ADD, mark, 2 * strlen(num1) + 5, num1);
+            if (testModelAdd(&engines.model, num1, num2) != added) testFail("phfwdAdd differs from model", num1);
+            if (phfwdAdd(engines.packed, num1, num2) != added) testFail("phfwdAdd on arena differs", num1);
+            if (phfwdOverlayAdd(engines.overlay, num1, num2) != added) testFail("phfwdOverlayAdd differs", num1);
+        } else if (kind < 7) {
+            TestMark mark = testMark();
+            phfwdRemove(engines.reference, num1);
+            testAccount(TEST_REMOVE, mark, 0, num1);
+            testModelRemove(&engines.model, num1);
+            phfwdRemove(engines.packed, num1);
+            phfwdOverlayRemove(engines.overlay, num1);
+        } else if (kind < 8) {
+            testBatch(&engines);
+        } else {
+            testQuery(&engines, num1);
+        }
+
+        if (test_step % TEST_CHECKPOINT == TEST_CHECKPOINT - 1) testCheckpoint(&engines);
+    }
+
+    phfwdOverlayDelete(engines.overlay);
+    phfwdDelete(engines.base);
+    phfwdDelete(engines.reference);
+    phfwdDelete(engines.packed);
+    if (phfwdArenaInUse(engines.arena) != 0) testFail("arena memory not returned", "");
+    phfwdArenaDelete(engines.arena);
+    phfwdThreadPoolDelete(engines.pool);
+    phfwdCompactorDelete(engines.compactor);
+    free(engines.model.pairs);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 0;
+    size_t operations = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000;
+    size_t runs = argc > 1 ? 1 : 16;
+
+    TestMark start = testMark();
+    if (!testFanIn()) {
+        fprintf(stderr, "FAIL: could not create structures for fan-in\n");
+        return 1;
+    }
+    if (!testCompactBulk()) {
+        fprintf(stderr, "FAIL: could not create structures for bulk removal\n");
+        return 1;
+    }
+    if (!testDiffFailure()) {
+        fprintf(stderr, "FAIL: could not create structures for diff failure\n");
+        return 1;
+    }
+    for (size_t run = 0; run < runs; run++) {
+        uint64_t run_seed = argc > 1 ? seed : 0x9e3779b97f4a7c15ULL * (run + 1);
+        if (!testRun(run_seed, operations)) {
+            fprintf(stderr, "FAIL: could not create structures (seed %" PRIu64 ")\n", run_seed);
+            return 1;
+        }
+    }
+    TestMark end = testMark();
+    if (end.allocs - start.allocs != end.frees - start.frees) {
+        fprintf(stderr, "FAIL: %" PRIu64 " blocks not freed\n",
+                (end.allocs - start.allocs) - (end.frees - start.frees));
+        return 1;
+    }
+
+    printf("%-24s %10s %12s %12s\n", "operation", "calls", "allocs/op", "bytes/op");
+    for (int op = 0; op < TEST_OP_AMOUNT; op++) {
+        if (test_stats[op].calls == 0) continue;
+        printf("%-24s %10" PRIu64 " %12.2f %12.1f\n", test_op_names[op], test_stats[op].calls,
+               (double) test_stats[op].allocs / (double) test_stats[op].calls,
+               (double) test_stats[op].bytes / (double) test_stats[op].calls);
+    }
+    printf("OK (%zu runs x %zu operations, %" PRIu64 " reallocs)\n", runs, operations,
+           testCounter(&test_counters.reallocs));
+    return 0;
+}